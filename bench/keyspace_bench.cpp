@@ -0,0 +1,158 @@
+/*
+Keyspace benchmark: std::unordered_map vs KeyTable
+
+Inserts N keys ("<prefix><i>", default 10M keys with prefix "key:"), then times hits and misses in a
+shuffled order and reports the resident memory each structure added and
+the insert latency tail (a resize that moves every key at once shows up
+as the max).
+The unordered_map baseline keeps the original entry layout (variant value
+and time_point expiry); KeyTable indexes Storage's flat Entry, allocated
+from a SlabAllocator. Each
+structure runs in its own child process so memory freed by one run can't
+be reused by the next.
+
+    ./keyspace_bench [keys] [prefix]
+*/
+
+#include "../include/entry.h"
+#include "../include/key_table.h"
+#include "../include/slab_allocator.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+using Value = std::variant<int64_t, double, std::string, bool>;
+
+struct MapValue {
+    Value value;
+    Clock::time_point expiry;
+    bool hasExpiry = false;
+};
+
+struct KeyHash {
+    using is_transparent = void;
+    size_t operator()(std::string_view key) const { return std::hash<std::string_view>{}(key); }
+};
+
+static size_t residentBytes() {
+    long pages = 0, resident = 0;
+    FILE *f = std::fopen("/proc/self/statm", "r");
+    if(!f) return 0;
+    if(std::fscanf(f, "%ld %ld", &pages, &resident) != 2) resident = 0;
+    std::fclose(f);
+    return static_cast<size_t>(resident) * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+static double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+struct Result {
+    double insert, hit, miss;
+    size_t bytes;
+    uint64_t p50, p999, max; // insert latency, ns
+};
+
+static void report(const char *name, size_t n, const Result &r) {
+    std::printf("%-14s insert %7.1f ns/key  hit %7.1f ns  miss %7.1f ns  memory %7.1f MB (%5.1f B/key)\n",
+                name, r.insert * 1e9 / n, r.hit * 1e9 / n, r.miss * 1e9 / n,
+                r.bytes / 1048576.0, static_cast<double>(r.bytes) / n);
+    std::printf("%-14s insert latency p50 %llu ns  p99.9 %llu ns  max %.2f ms\n", "",
+                static_cast<unsigned long long>(r.p50), static_cast<unsigned long long>(r.p999), r.max / 1e6);
+}
+
+template <typename Insert, typename Find>
+static Result run(const std::vector<std::string> &keys, const std::vector<std::string> &misses,
+                  const std::vector<size_t> &order, Insert insert, Find find) {
+    Result r{};
+    std::vector<uint64_t> latency(keys.size());
+    size_t before = residentBytes();
+
+    auto start = Clock::now();
+    for(size_t i=0; i<keys.size(); i++) {
+        auto t = Clock::now();
+        insert(keys[i]);
+        latency[i] = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - t).count());
+    }
+    r.insert = secondsSince(start);
+    r.bytes = residentBytes() - before;
+
+    std::sort(latency.begin(), latency.end());
+    r.p50 = latency[latency.size() / 2];
+    r.p999 = latency[latency.size() * 999 / 1000];
+    r.max = latency.back();
+
+    size_t found = 0;
+    start = Clock::now();
+    for(size_t i: order) found += find(keys[i]);
+    r.hit = secondsSince(start);
+
+    start = Clock::now();
+    for(size_t i: order) found += find(misses[i]);
+    r.miss = secondsSince(start);
+
+    if(found != keys.size()) std::fprintf(stderr, "lookup mismatch: %zu\n", found);
+    return r;
+}
+
+int main(int argc, char **argv) {
+    size_t n = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10000000;
+    std::string prefix = argc > 2 ? argv[2] : "key:";
+
+    std::vector<std::string> keys, misses;
+    keys.reserve(n);
+    misses.reserve(n);
+    for(size_t i=0; i<n; i++) {
+        keys.push_back(prefix + std::to_string(i));
+        misses.push_back("miss:" + std::to_string(i));
+    }
+    std::vector<size_t> order(n);
+    for(size_t i=0; i<n; i++) order[i] = i;
+    std::shuffle(order.begin(), order.end(), std::mt19937_64(42));
+
+    std::printf("%zu keys like \"%s\"\n", n, keys.empty() ? "" : keys.back().c_str());
+
+    // run fn in a forked child and wait for it
+    auto isolated = [](auto fn) {
+        std::fflush(stdout);
+        pid_t pid = fork();
+        if(pid == 0) {
+            fn();
+            std::fflush(stdout);
+            _exit(0);
+        }
+        int status = 0;
+        waitpid(pid, &status, 0);
+    };
+
+    isolated([&]() {
+        std::unordered_map<std::string, MapValue, KeyHash, std::equal_to<>> map;
+        Result r = run(keys, misses, order,
+            [&](const std::string &key) { map.emplace(key, MapValue{int64_t(1), {}, false}); },
+            [&](const std::string &key) { return map.find(std::string_view(key)) != map.end() ? 1 : 0; });
+        report("unordered_map", n, r);
+    });
+
+    isolated([&]() {
+        SlabAllocator slabs;
+        KeyTable<Entry, EntryKey> table;
+        Result r = run(keys, misses, order,
+            [&](const std::string &key) {
+                auto [slot, inserted] = table.insertSlot(key);
+                if(inserted) *slot = Entry::create(slabs, key, CompactValue::fromInt(1));
+            },
+            [&](const std::string &key) { return table.find(key) ? 1 : 0; });
+        report("KeyTable", n, r);
+        for(Entry *entry: table) Entry::destroy(slabs, entry);
+    });
+    return 0;
+}
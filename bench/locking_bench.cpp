@@ -0,0 +1,111 @@
+/*
+GET throughput under a writer: exclusive vs shared vs sharded vs lock-free
+
+Reader threads GET random keys from a preloaded keyspace while one writer
+thread keeps overwriting random keys, the shape of a read-mostly cache.
+Each read mode of Storage runs at 1 to 64 reader threads; "sharded" splits
+the keyspace over several exclusive-mode Storages, so readers only queue
+behind others on the same shard. Reports reads and writes per second.
+
+    ./locking_bench [keys] [ms per run] [shards]
+*/
+
+#include "../include/storage.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+struct Target {
+    const char *name;
+    std::vector<std::unique_ptr<Storage>> shards;
+
+    Storage &shardFor(const std::string &key) {
+        return *shards[std::hash<std::string>{}(key) % shards.size()];
+    }
+};
+
+static Target makeTarget(const char *name, ReadMode mode, size_t shards, size_t keys) {
+    StorageOptions options;
+    options.read_mode = mode;
+    Target target{name, {}};
+    for(size_t i=0; i<shards; i++) target.shards.push_back(std::make_unique<Storage>(options));
+    for(size_t i=0; i<keys; i++) {
+        std::string key = "key:" + std::to_string(i);
+        target.shardFor(key).set(key, "value:" + std::to_string(i));
+    }
+    return target;
+}
+
+static void run(Target &target, size_t keys, unsigned readers, std::chrono::milliseconds duration) {
+    std::atomic<bool> start{false}, done{false};
+    std::atomic<long> reads{0}, writes{0};
+
+    std::vector<std::thread> threads;
+    for(unsigned r=0; r<readers; r++) {
+        threads.emplace_back([&, r]() {
+            std::mt19937_64 rng(r + 1);
+            long n = 0;
+            while(!start) std::this_thread::yield();
+            while(!done) {
+                std::string key = "key:" + std::to_string(rng() % keys);
+                if(target.shardFor(key).get(key)) n++;
+            }
+            reads += n;
+        });
+    }
+    threads.emplace_back([&]() {
+        std::mt19937_64 rng(0);
+        long n = 0;
+        while(!start) std::this_thread::yield();
+        while(!done) {
+            std::string key = "key:" + std::to_string(rng() % keys);
+            target.shardFor(key).set(key, "value:" + std::to_string(n));
+            if(++n % 64 == 0) std::this_thread::yield(); // a writer trickle, not a write storm
+        }
+        writes += n;
+    });
+
+    auto began = Clock::now();
+    start = true;
+    std::this_thread::sleep_for(duration);
+    done = true;
+    for(auto &t: threads) t.join();
+    double secs = std::chrono::duration<double>(Clock::now() - began).count();
+
+    std::printf("%-10s %8u %14.0f %14.0f\n", target.name, readers, reads / secs, writes / secs);
+}
+
+int main(int argc, char **argv) {
+    size_t keys = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 100000;
+    std::chrono::milliseconds duration(argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 200);
+    size_t shards = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 16;
+    if(keys == 0 || shards == 0) {
+        std::fprintf(stderr, "usage: %s [keys] [ms per run] [shards]\n", argv[0]);
+        return 1;
+    }
+
+    std::printf("%zu keys, %lld ms per run, %zu shards, %u hardware threads\n\n",
+                keys, static_cast<long long>(duration.count()), shards, std::thread::hardware_concurrency());
+    std::printf("%-10s %8s %14s %14s\n", "mode", "readers", "reads/s", "writes/s");
+
+    Target targets[] = {
+        makeTarget("exclusive", ReadMode::Exclusive, 1, keys),
+        makeTarget("shared", ReadMode::Shared, 1, keys),
+        makeTarget("sharded", ReadMode::Exclusive, shards, keys),
+        makeTarget("lockfree", ReadMode::LockFree, 1, keys),
+    };
+    for(Target &target: targets) {
+        for(unsigned readers: {1u, 2u, 4u, 8u, 16u, 32u, 64u}) run(target, keys, readers, duration);
+        std::printf("\n");
+    }
+    return 0;
+}
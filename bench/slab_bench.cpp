@@ -0,0 +1,96 @@
+/*
+Entry allocation churn: global heap vs SlabAllocator
+
+Fills a pool of live entries with mixed sizes (mostly small, a few
+hundred-byte values), then replaces random entries with new sizes, the
+allocation pattern of SET/DEL churn on a cache. Reports time per
+replacement and the resident memory against the bytes actually live.
+Each allocator runs in its own child process.
+
+    ./slab_bench [live entries] [replacements]
+*/
+
+#include "../include/entry.h"
+#include "../include/slab_allocator.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+static size_t residentBytes() {
+    long pages = 0, resident = 0;
+    FILE *f = std::fopen("/proc/self/statm", "r");
+    if(!f) return 0;
+    if(std::fscanf(f, "%ld %ld", &pages, &resident) != 2) resident = 0;
+    std::fclose(f);
+    return static_cast<size_t>(resident) * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+// Value sizes: 80% up to 15 bytes (inline), 15% up to 100, 5% up to 1000
+static size_t valueSize(std::mt19937_64 &rng) {
+    unsigned roll = rng() % 100;
+    if(roll < 80) return rng() % 16;
+    if(roll < 95) return 16 + rng() % 85;
+    return 100 + rng() % 900;
+}
+
+template <typename Alloc>
+static void run(const char *name, size_t live, size_t churn) {
+    Alloc alloc;
+    std::mt19937_64 rng(7);
+    std::string text(1000, 'v');
+    std::vector<Entry *> entries(live);
+    size_t before = residentBytes();
+
+    auto make = [&](size_t i) {
+        std::string key = "key:" + std::to_string(i);
+        return Entry::create(alloc, key, CompactValue::borrow(std::string_view(text).substr(0, valueSize(rng))));
+    };
+
+    for(size_t i=0; i<live; i++) entries[i] = make(i);
+
+    auto start = Clock::now();
+    for(size_t n=0; n<churn; n++) {
+        size_t i = rng() % live;
+        Entry::destroy(alloc, entries[i]);
+        entries[i] = make(i);
+    }
+    double secs = std::chrono::duration<double>(Clock::now() - start).count();
+
+    size_t logical = 0;
+    for(Entry *e: entries) logical += sizeof(Entry) + e->key_len + Entry::tailSize(e->value);
+    size_t rss = residentBytes() - before;
+
+    std::printf("%-6s replace %6.1f ns  resident %7.1f MB  live %7.1f MB  overhead %.2fx\n",
+                name, secs * 1e9 / churn, rss / 1048576.0, logical / 1048576.0,
+                static_cast<double>(rss) / logical);
+    for(Entry *e: entries) Entry::destroy(alloc, e);
+}
+
+int main(int argc, char **argv) {
+    size_t live = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 2000000;
+    size_t churn = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 20000000;
+    std::printf("%zu live entries, %zu replacements\n", live, churn);
+
+    auto isolated = [](auto fn) {
+        std::fflush(stdout);
+        pid_t pid = fork();
+        if(pid == 0) {
+            fn();
+            std::fflush(stdout);
+            _exit(0);
+        }
+        int status = 0;
+        waitpid(pid, &status, 0);
+    };
+
+    isolated([&]() { run<Entry::HeapAllocator>("heap", live, churn); });
+    isolated([&]() { run<SlabAllocator>("slab", live, churn); });
+    return 0;
+}
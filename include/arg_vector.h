@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+// Command arguments as views into the line being parsed.
+// The first INLINE_CAPACITY arguments live inside the object; only longer
+// commands spill to the heap, so typical commands parse without allocating.
+class ArgVector {
+public:
+    static constexpr size_t INLINE_CAPACITY = 8;
+
+    ArgVector() = default;
+    ArgVector(const ArgVector &) = delete;
+    ArgVector &operator=(const ArgVector &) = delete;
+
+    void push_back(std::string_view arg) {
+        if(size_ < INLINE_CAPACITY) {
+            inline_[size_++] = arg;
+            return;
+        }
+        if(size_ == INLINE_CAPACITY) heap_.assign(inline_, inline_ + INLINE_CAPACITY);
+        heap_.push_back(arg);
+        size_++;
+    }
+
+    void clear() {
+        size_ = 0;
+        heap_.clear();
+    }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    bool spilled() const { return size_ > INLINE_CAPACITY; }
+
+    const std::string_view *begin() const { return spilled() ? heap_.data() : inline_; }
+    const std::string_view *end() const { return begin() + size_; }
+    std::string_view operator[](size_t i) const { return begin()[i]; }
+
+private:
+    std::string_view inline_[INLINE_CAPACITY];
+    std::vector<std::string_view> heap_;
+    size_t size_ = 0;
+};
@@ -0,0 +1,185 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+
+/*
+ * Immutable, reference-counted byte buffer for large string values.
+ *
+ * The bytes are written once by create() and never change, so any number
+ * of threads may read them while they hold a reference. Storage keeps one
+ * reference in the entry; a GET hands another to the connection, whose
+ * output buffer sends the bytes straight from the blob and drops its
+ * reference once they are out. Whoever lets go last frees it.
+ *
+ * A blob comes either from the heap or from an allocator that is only safe
+ * under its owner's lock (Storage's slabs). Since the last reference may
+ * drop on any thread, a pooled blob isn't freed there: it is parked on its
+ * owner's BlobFreeList, which the owner empties under its lock. Pooled
+ * blobs must not outlive their owner.
+ *
+ *   [refs 4][size 4][home 8][bytes ...]   one allocation
+ */
+class BlobFreeList;
+
+class Blob {
+private:
+    friend class BlobFreeList;
+
+    mutable std::atomic<uint32_t> refs_;
+    uint32_t size_;
+    union {
+        BlobFreeList *home_; // where the last release parks it; nullptr for heap blobs
+        Blob *next_;         // once parked
+    };
+
+    Blob(uint32_t size, BlobFreeList *home) : refs_(1), size_(size), home_(home) {}
+
+    static uint32_t checkedSize(std::string_view bytes) {
+        if(bytes.size() > std::numeric_limits<uint32_t>::max()) throw std::length_error("value too large");
+        return static_cast<uint32_t>(bytes.size());
+    }
+
+public:
+    Blob(const Blob &) = delete;
+    Blob &operator=(const Blob &) = delete;
+
+    // Bytes one allocation takes for a blob of n bytes
+    static constexpr size_t allocSize(size_t n) { return sizeof(Blob) + n; }
+
+    // A copy of bytes with a reference count of 1, owned by the caller
+    static Blob *create(std::string_view bytes) {
+        uint32_t size = checkedSize(bytes);
+        Blob *blob = new (::operator new(allocSize(size))) Blob(size, nullptr);
+        std::memcpy(reinterpret_cast<char *>(blob + 1), bytes.data(), size);
+        return blob;
+    }
+
+    // Same, in memory from alloc (allocate(size)/deallocate(p, size), as
+    // for Entry). The last release parks it on home, whose owner hands it
+    // back to destroy(alloc, blob).
+    template <typename Alloc>
+    static Blob *create(Alloc &alloc, BlobFreeList &home, std::string_view bytes) {
+        uint32_t size = checkedSize(bytes);
+        Blob *blob = new (alloc.allocate(allocSize(size))) Blob(size, &home);
+        std::memcpy(reinterpret_cast<char *>(blob + 1), bytes.data(), size);
+        return blob;
+    }
+
+    template <typename Alloc>
+    static void destroy(Alloc &alloc, Blob *blob) {
+        size_t size = allocSize(blob->size_);
+        blob->~Blob();
+        alloc.deallocate(blob, size);
+    }
+
+    void retain() const { refs_.fetch_add(1, std::memory_order_relaxed); }
+
+    // The last release frees a heap blob and parks a pooled one
+    inline void release() const;
+
+    // Whether the blob came from an owner's allocator
+    bool pooled() const { return home_ != nullptr; }
+
+    const char *data() const { return reinterpret_cast<const char *>(this + 1); }
+    size_t size() const { return size_; }
+    std::string_view view() const { return {data(), size_}; }
+
+    uint32_t refs() const { return refs_.load(std::memory_order_relaxed); }
+};
+
+// Pooled blobs whose last reference is gone. Any thread may push; the owner
+// takes them all under its lock and destroys them.
+class BlobFreeList {
+private:
+    std::atomic<Blob *> head_{nullptr};
+
+public:
+    void push(Blob *blob) {
+        Blob *head = head_.load(std::memory_order_relaxed);
+        do {
+            blob->next_ = head;
+        } while(!head_.compare_exchange_weak(head, blob, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    bool empty() const { return head_.load(std::memory_order_relaxed) == nullptr; }
+
+    // Unlink every parked blob and pass each to fn
+    template <typename Fn>
+    void drain(Fn fn) {
+        Blob *blob = head_.exchange(nullptr, std::memory_order_acquire);
+        while(blob) {
+            Blob *next = blob->next_;
+            fn(blob);
+            blob = next;
+        }
+    }
+};
+
+void Blob::release() const {
+    if(refs_.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+    Blob *self = const_cast<Blob *>(this);
+    if(home_) {
+        home_->push(self);
+    } else {
+        self->~Blob();
+        ::operator delete(self);
+    }
+}
+
+// Owning handle to a Blob: copies share it, the last one frees it
+class BlobRef {
+private:
+    const Blob *blob_ = nullptr;
+
+public:
+    BlobRef() = default;
+
+    // Take over a reference the caller already holds
+    static BlobRef adopt(const Blob *blob) {
+        BlobRef ref;
+        ref.blob_ = blob;
+        return ref;
+    }
+
+    // Add a reference of our own
+    static BlobRef share(const Blob *blob) {
+        if(blob) blob->retain();
+        return adopt(blob);
+    }
+
+    static BlobRef create(std::string_view bytes) { return adopt(Blob::create(bytes)); }
+
+    ~BlobRef() { reset(); }
+
+    BlobRef(const BlobRef &other) : blob_(other.blob_) {
+        if(blob_) blob_->retain();
+    }
+    BlobRef(BlobRef &&other) noexcept : blob_(std::exchange(other.blob_, nullptr)) {}
+
+    BlobRef &operator=(BlobRef other) noexcept {
+        std::swap(blob_, other.blob_);
+        return *this;
+    }
+
+    void reset() {
+        if(blob_) blob_->release();
+        blob_ = nullptr;
+    }
+
+    // Hand the reference over to the caller
+    const Blob *release() { return std::exchange(blob_, nullptr); }
+
+    const Blob *get() const { return blob_; }
+    explicit operator bool() const { return blob_ != nullptr; }
+
+    std::string_view view() const { return blob_ ? blob_->view() : std::string_view(); }
+    size_t size() const { return blob_ ? blob_->size() : 0; }
+};
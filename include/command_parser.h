@@ -1,23 +1,114 @@
 #pragma once
 #include "storage.h"
+#include "output_buffer.h"
+#include "arg_vector.h"
+#include "session.h"
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 
 class CommandParser {
+public:
+    // Command flags, reported by COMMAND INFO
+    enum CommandFlags : uint32_t {
+        CMD_WRITE    = 1 << 0, // may modify the store
+        CMD_READONLY = 1 << 1, // never modifies the store
+        CMD_ADMIN    = 1 << 2, // touches files or server state
+    };
+
 private:
+    friend struct CommandTable; // compile-time dispatch table (command_parser.cpp)
+
+    using Handler = std::string (CommandParser::*)(const ArgVector &args, OutputBuffer &out);
+
+    struct CommandSpec {
+        std::string_view name;
+        int arity;          // token count including the name; -N means at least N
+        uint32_t flags;
+        Handler handler;
+        std::string_view usage;
+    };
+
     Storage &store;
+    Session &session; // per-connection state (data directory, ...)
 
-    int clientSock; // unique per client
+    // Holds tokens that can't be plain slices of the line (escapes, quotes
+    // inside a token). Reused across commands.
+    std::string scratch_;
 
-    // Helper: tokenize with quotes
-    std::vector<std::string> tokenize(const std::string &line);
+    // Helper: split a line into arguments, respecting quotes and \" escapes.
+    // Arguments point into line (or scratch_) and stay valid until the next call.
+    void tokenize(std::string_view line, ArgVector &args);
 
     // Helper: convert string to variant value
-    Storage::Value parseValue(const std::string &token);
+    Storage::Value parseValue(std::string_view token);
+
+    // Case-insensitive lookup in the command table, nullptr if unknown
+    static const CommandSpec *lookupCommand(std::string_view name);
+    static std::string flagsToString(uint32_t flags);
+
+    // Run a tokenized command. Small replies are returned, bulky ones
+    // (SHOW) are streamed straight into out.
+    std::string run(const ArgVector &args, OutputBuffer &out);
+
+    // Rows SHOW reads from the store per batch
+    static constexpr size_t SHOW_BATCH = 256;
+
+    // Whether a bulky reply has filled out past the session's output limit
+    bool overOutputLimit(const OutputBuffer &out) const {
+        return session.outputLimit() && out.size() > session.outputLimit();
+    }
+
+    // Shared by PEXPIRE, EXPIREAT and PEXPIREAT: the argument is in unit_ms
+    // milliseconds, and a Unix time if absolute
+    std::string pexpire(const ArgVector &args, int64_t unit_ms, bool absolute);
+
+    // Shared by MSET and MSETNX
+    std::string setMany(const ArgVector &args, bool only_if_none_exist);
+
+    // Shared by INCR, DECR, INCRBY and DECRBY; striped for their C* twins
+    std::string incrBy(std::string_view key, int64_t delta, bool striped = false);
+
+    // Command handlers
+    std::string cmdSet(const ArgVector &args, OutputBuffer &out);
+    std::string cmdGet(const ArgVector &args, OutputBuffer &out);
+    std::string cmdGetSet(const ArgVector &args, OutputBuffer &out);
+    std::string cmdGetDel(const ArgVector &args, OutputBuffer &out);
+    std::string cmdCas(const ArgVector &args, OutputBuffer &out);
+    std::string cmdDel(const ArgVector &args, OutputBuffer &out);
+    std::string cmdExists(const ArgVector &args, OutputBuffer &out);
+    std::string cmdExpire(const ArgVector &args, OutputBuffer &out);
+    std::string cmdPExpire(const ArgVector &args, OutputBuffer &out);
+    std::string cmdExpireAt(const ArgVector &args, OutputBuffer &out);
+    std::string cmdPExpireAt(const ArgVector &args, OutputBuffer &out);
+    std::string cmdTtl(const ArgVector &args, OutputBuffer &out);
+    std::string cmdPTtl(const ArgVector &args, OutputBuffer &out);
+    std::string cmdPersist(const ArgVector &args, OutputBuffer &out);
+    std::string cmdMGet(const ArgVector &args, OutputBuffer &out);
+    std::string cmdMSet(const ArgVector &args, OutputBuffer &out);
+    std::string cmdMSetNx(const ArgVector &args, OutputBuffer &out);
+    std::string cmdIncr(const ArgVector &args, OutputBuffer &out);
+    std::string cmdDecr(const ArgVector &args, OutputBuffer &out);
+    std::string cmdIncrBy(const ArgVector &args, OutputBuffer &out);
+    std::string cmdDecrBy(const ArgVector &args, OutputBuffer &out);
+    std::string cmdIncrByFloat(const ArgVector &args, OutputBuffer &out);
+    std::string cmdCIncr(const ArgVector &args, OutputBuffer &out);
+    std::string cmdCDecr(const ArgVector &args, OutputBuffer &out);
+    std::string cmdCIncrBy(const ArgVector &args, OutputBuffer &out);
+    std::string cmdCDecrBy(const ArgVector &args, OutputBuffer &out);
+    std::string cmdShow(const ArgVector &args, OutputBuffer &out);
+    std::string cmdSave(const ArgVector &args, OutputBuffer &out);
+    std::string cmdLoad(const ArgVector &args, OutputBuffer &out);
+    std::string cmdCommand(const ArgVector &args, OutputBuffer &out);
+    std::string cmdMemory(const ArgVector &args, OutputBuffer &out);
 
 public:
-    CommandParser(Storage &store, int clientSock);
+    CommandParser(Storage &store, Session &session);
 
     // Parse a line of input and execute the command
-    std::string execute(const std::string &line);
-};
\ No newline at end of file
+    std::string execute(std::string_view line);
+
+    // Same, appending the reply to a connection's output buffer
+    void execute(std::string_view line, OutputBuffer &out);
+};
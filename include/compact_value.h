@@ -0,0 +1,222 @@
+#pragma once
+
+#include "blob.h"
+#include "striped_counter.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <stdexcept>
+#include <string_view>
+
+/*
+ * 16-byte tagged value used for everything Storage keeps.
+ *
+ * The last byte is a tag and the first 15 bytes hold the payload:
+ *   tag 0..15    string of that length stored inline in bytes 0..14
+ *   TAG_INT      int64 in bytes 0..7
+ *   TAG_DOUBLE   double in bytes 0..7
+ *   TAG_BOOL     bool in byte 0
+ *   TAG_HEAP     pointer in bytes 0..7, uint32 length in bytes 8..11
+ *   TAG_EXTERNAL same layout as TAG_HEAP, but the bytes are not owned
+ *   TAG_BLOB     Blob pointer in bytes 0..7, uint32 length in bytes 8..11
+ *   TAG_COUNTER  StripedCounter pointer in bytes 0..7; reads as an Int
+ * Longer strings live out of line in a malloc'd buffer owned by the value,
+ * or, for borrow(), in memory owned by someone else (e.g. the tail of a
+ * flat Entry), or in a shared Blob the value holds one reference to.
+ * Copying a blob or counter value shares it instead of copying it.
+ */
+class CompactValue {
+public:
+    enum class Type : uint8_t { Int, Double, Bool, String };
+
+    static constexpr size_t INLINE_CAPACITY = 15;
+
+private:
+    static constexpr uint8_t TAG_INT = 0x10;
+    static constexpr uint8_t TAG_DOUBLE = 0x11;
+    static constexpr uint8_t TAG_BOOL = 0x12;
+    static constexpr uint8_t TAG_HEAP = 0x13;
+    static constexpr uint8_t TAG_EXTERNAL = 0x14;
+    static constexpr uint8_t TAG_BLOB = 0x15;
+    static constexpr uint8_t TAG_COUNTER = 0x16;
+
+    alignas(8) unsigned char bytes_[INLINE_CAPACITY];
+    uint8_t tag_;
+
+    template <typename T>
+    T load(size_t offset) const {
+        T v;
+        std::memcpy(&v, bytes_ + offset, sizeof(T));
+        return v;
+    }
+
+    template <typename T>
+    void store(size_t offset, T v) { std::memcpy(bytes_ + offset, &v, sizeof(T)); }
+
+    void release() {
+        if(tag_ == TAG_HEAP) std::free(load<char *>(0));
+        else if(tag_ == TAG_BLOB) load<const Blob *>(0)->release();
+        else if(tag_ == TAG_COUNTER) load<StripedCounter *>(0)->release();
+        tag_ = 0;
+    }
+
+    void assignString(std::string_view s) {
+        if(s.size() <= INLINE_CAPACITY) {
+            std::memcpy(bytes_, s.data(), s.size());
+            tag_ = static_cast<uint8_t>(s.size());
+            return;
+        }
+        if(s.size() > std::numeric_limits<uint32_t>::max()) throw std::length_error("value too large");
+
+        char *buf = static_cast<char *>(std::malloc(s.size()));
+        if(!buf) throw std::bad_alloc();
+        std::memcpy(buf, s.data(), s.size());
+        store<char *>(0, buf);
+        store<uint32_t>(8, static_cast<uint32_t>(s.size()));
+        tag_ = TAG_HEAP;
+    }
+
+    void copyFrom(const CompactValue &other) {
+        if(other.tag_ == TAG_HEAP) {
+            assignString(other.asString());
+        } else {
+            if(other.tag_ == TAG_BLOB) other.load<const Blob *>(0)->retain();
+            if(other.tag_ == TAG_COUNTER) other.load<StripedCounter *>(0)->retain();
+            std::memcpy(bytes_, other.bytes_, INLINE_CAPACITY);
+            tag_ = other.tag_;
+        }
+    }
+
+    void moveFrom(CompactValue &other) {
+        std::memcpy(bytes_, other.bytes_, INLINE_CAPACITY);
+        tag_ = other.tag_;
+        other.tag_ = 0; // the buffer, if any, now belongs to us
+    }
+
+public:
+    // An empty string
+    CompactValue() : bytes_{}, tag_(0) {}
+
+    static CompactValue fromInt(int64_t v) {
+        CompactValue c;
+        c.store(0, v);
+        c.tag_ = TAG_INT;
+        return c;
+    }
+
+    static CompactValue fromDouble(double v) {
+        CompactValue c;
+        c.store(0, v);
+        c.tag_ = TAG_DOUBLE;
+        return c;
+    }
+
+    static CompactValue fromBool(bool v) {
+        CompactValue c;
+        c.bytes_[0] = v;
+        c.tag_ = TAG_BOOL;
+        return c;
+    }
+
+    static CompactValue fromString(std::string_view s) {
+        CompactValue c;
+        c.assignString(s);
+        return c;
+    }
+
+    // Refer to s without copying it when it doesn't fit inline. The caller
+    // keeps the bytes alive for as long as the value (or copies of it) live.
+    static CompactValue borrow(std::string_view s) {
+        if(s.size() <= INLINE_CAPACITY) return fromString(s);
+        if(s.size() > std::numeric_limits<uint32_t>::max()) throw std::length_error("value too large");
+        CompactValue c;
+        c.store<const char *>(0, s.data());
+        c.store<uint32_t>(8, static_cast<uint32_t>(s.size()));
+        c.tag_ = TAG_EXTERNAL;
+        return c;
+    }
+
+    // Hold blob's reference (the value now owns it). Empty blobs are fine.
+    static CompactValue fromBlob(BlobRef blob) {
+        CompactValue c;
+        if(!blob) return c;
+        c.store<uint32_t>(8, static_cast<uint32_t>(blob.size()));
+        c.store<const Blob *>(0, blob.release());
+        c.tag_ = TAG_BLOB;
+        return c;
+    }
+
+    // Take over the caller's reference to counter
+    static CompactValue fromCounter(StripedCounter *counter) {
+        CompactValue c;
+        c.store<StripedCounter *>(0, counter);
+        c.tag_ = TAG_COUNTER;
+        return c;
+    }
+
+    ~CompactValue() { release(); }
+
+    CompactValue(const CompactValue &other) : tag_(0) { copyFrom(other); }
+    CompactValue(CompactValue &&other) noexcept { moveFrom(other); }
+
+    CompactValue &operator=(const CompactValue &other) {
+        if(this != &other) {
+            CompactValue copy(other); // allocate before giving up our own buffer
+            release();
+            moveFrom(copy);
+        }
+        return *this;
+    }
+
+    CompactValue &operator=(CompactValue &&other) noexcept {
+        if(this != &other) {
+            release();
+            moveFrom(other);
+        }
+        return *this;
+    }
+
+    Type type() const {
+        switch(tag_) {
+            case TAG_INT:
+            case TAG_COUNTER: return Type::Int;
+            case TAG_DOUBLE: return Type::Double;
+            case TAG_BOOL: return Type::Bool;
+            default: return Type::String;
+        }
+    }
+
+    // Accessors assume type() matches
+    int64_t asInt() const { return tag_ == TAG_COUNTER ? counter()->sum() : load<int64_t>(0); }
+    double asDouble() const { return load<double>(0); }
+    bool asBool() const { return bytes_[0] != 0; }
+    std::string_view asString() const {
+        if(tag_ == TAG_HEAP || tag_ == TAG_EXTERNAL) return {load<char *>(0), load<uint32_t>(8)};
+        if(tag_ == TAG_BLOB) return {load<const Blob *>(0)->data(), load<uint32_t>(8)};
+        return {reinterpret_cast<const char *>(bytes_), tag_};
+    }
+
+    // True when the whole value lives in these 16 bytes
+    bool isInline() const { return tag_ != TAG_HEAP && tag_ != TAG_EXTERNAL && tag_ != TAG_BLOB && tag_ != TAG_COUNTER; }
+
+    bool isBorrowed() const { return tag_ == TAG_EXTERNAL; }
+
+    bool isBlob() const { return tag_ == TAG_BLOB; }
+    // Another reference to the blob; requires isBlob()
+    BlobRef blob() const { return BlobRef::share(load<const Blob *>(0)); }
+    // The blob itself, valid while this value lives; requires isBlob()
+    const Blob *blobPtr() const { return load<const Blob *>(0); }
+
+    bool isCounter() const { return tag_ == TAG_COUNTER; }
+    // The shared counter, valid while this value lives; requires isCounter()
+    StripedCounter *counter() const { return load<StripedCounter *>(0); }
+
+    // A copy that doesn't depend on borrowed bytes staying alive: borrowed
+    // strings are copied, blobs are shared, everything else is 16 bytes
+    CompactValue owned() const { return isBorrowed() ? fromString(asString()) : *this; }
+};
+
+static_assert(sizeof(CompactValue) == 16, "CompactValue must stay 16 bytes");
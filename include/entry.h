@@ -0,0 +1,145 @@
+#pragma once
+
+#include "compact_value.h"
+#include "slab_allocator.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string_view>
+
+/*
+ * Flat keyspace entry: one allocation holds the header, the key bytes and,
+ * for strings too long for CompactValue's inline buffer, the value bytes
+ * right after the key.
+ *
+ *   [meta 8][value 16][key_len 4][alloc_size 4][key ...][long value ...]
+ *
+ * The header is 32 bytes and allocations are rounded to a slab size class
+ * (48, 64, 80, ... bytes). Slab chunks are only 16-byte aligned, so even a
+ * small entry may straddle two cache lines: a 48-byte chunk does whenever it
+ * starts in the last 32 bytes of a line. Keeping the key right after the
+ * header means a hit still reads meta, value and key from one or two
+ * adjacent lines. create()/destroy() take any allocator with allocate(size)
+ * and deallocate(p, size); Storage passes its SlabAllocator. A value held in a
+ * shared Blob or StripedCounter stays there: the entry keeps a reference.
+ *
+ * Once an entry is reachable by lock-free readers only meta may change: the
+ * writer updates the expiry and readers the access bits, both through
+ * atomic read-modify-writes on the whole word. An overwrite publishes a new
+ * entry and retires the old one.
+ */
+struct Entry {
+    // meta: bits 0-39 expiry in steady-clock ms (0 = none, ~34 years of
+    // uptime), 40-63 access info kept for eviction (LRU clock or LFU counter)
+    static constexpr unsigned ACCESS_SHIFT = 40;
+    static constexpr uint64_t EXPIRY_MASK = (uint64_t(1) << ACCESS_SHIFT) - 1;
+    static constexpr uint32_t ACCESS_MASK = (1u << 24) - 1;
+
+    uint64_t meta;
+    CompactValue value; // long strings are borrowed from the entry's tail
+    uint32_t key_len;
+    uint32_t alloc_size; // bytes actually allocated, header included
+
+    // Key bytes start right after the header
+    char *tail() { return reinterpret_cast<char *>(this + 1); }
+    const char *tail() const { return reinterpret_cast<const char *>(this + 1); }
+
+    std::string_view key() const { return {tail(), key_len}; }
+
+    uint64_t loadMeta() const {
+        return std::atomic_ref<uint64_t>(const_cast<uint64_t &>(meta)).load(std::memory_order_relaxed);
+    }
+    // Keep the bits of meta set in keep and OR in bits
+    void updateMeta(uint64_t keep, uint64_t bits) {
+        std::atomic_ref<uint64_t> ref(meta);
+        uint64_t cur = ref.load(std::memory_order_relaxed);
+        while(!ref.compare_exchange_weak(cur, (cur & keep) | bits, std::memory_order_relaxed)) {}
+    }
+
+    uint64_t expiryMs() const { return loadMeta() & EXPIRY_MASK; }
+    bool hasExpiry() const { return expiryMs() != 0; }
+    bool expiredAt(uint64_t now_ms) const { return hasExpiry() && now_ms >= expiryMs(); }
+    void setExpiryMs(uint64_t ms) { updateMeta(~EXPIRY_MASK, ms < EXPIRY_MASK ? ms : EXPIRY_MASK); }
+
+    uint32_t access() const { return static_cast<uint32_t>(loadMeta() >> ACCESS_SHIFT); }
+    void setAccess(uint32_t a) { updateMeta(EXPIRY_MASK, uint64_t(a & ACCESS_MASK) << ACCESS_SHIFT); }
+
+    // Bytes the value needs after the key
+    static size_t tailSize(const CompactValue &v) {
+        return v.type() == CompactValue::Type::String && !v.isInline() && !v.isBlob() ? v.asString().size() : 0;
+    }
+
+    // Bytes the value holds outside the entry (a blob or a striped counter)
+    size_t externalSize() const {
+        if(value.isBlob()) return value.asString().size();
+        if(value.isCounter()) return value.counter()->footprint();
+        return 0;
+    }
+
+    static constexpr size_t sizeClass(size_t n) { return SlabAllocator::sizeClass(n); }
+
+    static size_t sizeFor(std::string_view key, const CompactValue &v) {
+        return sizeClass(sizeof(Entry) + key.size() + tailSize(v));
+    }
+
+    // fits() and setValue() are for entries no reader can reach yet, such
+    // as one create() is filling in: changing a published value would race
+    // with lock-free readers.
+
+    // Whether v can replace the current value without reallocating
+    bool fits(const CompactValue &v) const { return sizeof(Entry) + key_len + tailSize(v) <= alloc_size; }
+
+    // Replace the value; requires fits(v). Keeps meta.
+    void setValue(const CompactValue &v) {
+        if(tailSize(v)) {
+            char *dst = tail() + key_len;
+            std::string_view s = v.asString();
+            std::memmove(dst, s.data(), s.size());
+            value = CompactValue::borrow({dst, s.size()});
+        } else {
+            value = v;
+        }
+    }
+
+    // Plain global-heap allocator for entries that live outside a Storage
+    struct HeapAllocator {
+        void *allocate(size_t size) { return ::operator new(size); }
+        void deallocate(void *p, size_t) { ::operator delete(p); }
+    };
+
+    template <typename Alloc>
+    static Entry *create(Alloc &alloc, std::string_view key, const CompactValue &v, uint64_t meta = 0) {
+        size_t size = sizeFor(key, v);
+        Entry *e = new (alloc.allocate(size)) Entry{meta, CompactValue(), static_cast<uint32_t>(key.size()),
+                                                   static_cast<uint32_t>(size)};
+        std::memcpy(e->tail(), key.data(), key.size());
+        e->setValue(v);
+        return e;
+    }
+
+    template <typename Alloc>
+    static void destroy(Alloc &alloc, Entry *e) {
+        size_t size = e->alloc_size;
+        e->~Entry();
+        alloc.deallocate(e, size);
+    }
+
+    static Entry *create(std::string_view key, const CompactValue &v, uint64_t meta = 0) {
+        HeapAllocator heap;
+        return create(heap, key, v, meta);
+    }
+
+    static void destroy(Entry *e) {
+        HeapAllocator heap;
+        destroy(heap, e);
+    }
+};
+
+static_assert(sizeof(Entry) == 32, "Entry header must stay 32 bytes");
+
+// KeyOf adapter for KeyTable
+struct EntryKey {
+    std::string_view operator()(const Entry *entry) const { return entry->key(); }
+};
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * Epoch-based reclamation for lock-free readers.
+ *
+ * A reader pins the current global epoch while it reads (epoch::Guard).
+ * A writer that unlinks an object hands it to a RetireList, which stamps
+ * it with the epoch of the moment and frees it only once every pinned
+ * reader has moved past that epoch. No reader can then still hold a
+ * pointer it found before the unlink.
+ *
+ * Each thread takes a reader slot on its first Guard and gives it back
+ * when it exits. Slots come in blocks of READERS_PER_BLOCK; when every one
+ * is taken another block is added, so a new reader never waits. Guards
+ * nest and cost two stores and a fence.
+ */
+namespace epoch {
+
+constexpr size_t READERS_PER_BLOCK = 1024;
+
+class Guard {
+public:
+    Guard();
+    ~Guard();
+    Guard(const Guard &) = delete;
+    Guard &operator=(const Guard &) = delete;
+};
+
+// Objects waiting for readers to move on. Not thread-safe: it belongs to
+// one writer (Storage uses its own under its lock).
+class RetireList {
+public:
+    using Deleter = void (*)(void *context, void *object);
+
+    RetireList() = default;
+    ~RetireList(); // frees everything; the owner guarantees no reader is left
+    RetireList(const RetireList &) = delete;
+    RetireList &operator=(const RetireList &) = delete;
+
+    void retire(void *object, Deleter deleter, void *context = nullptr);
+
+    // Free whatever no pinned reader can still see; returns how many
+    size_t reclaim();
+
+    size_t pending() const { return items_.size(); }
+
+private:
+    struct Item {
+        uint64_t epoch;
+        void *object;
+        Deleter deleter;
+        void *context;
+    };
+    std::vector<Item> items_; // in retire order, so epochs never decrease
+};
+
+} // namespace epoch
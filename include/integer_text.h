@@ -0,0 +1,76 @@
+#pragma once
+
+#include <array>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/*
+ * Decimal text of an int64 for replies.
+ *
+ * 0..SHARED-1 are rendered once, at compile time, into a table every
+ * connection shares (the same idea as Redis's shared integers), so
+ * replying with a small counter or flag formats nothing. Anything else is
+ * written with std::to_chars into the object's own buffer: no allocation,
+ * no locale.
+ */
+namespace integer_text_detail {
+
+constexpr int64_t SHARED = 10000;
+constexpr size_t SHARED_DIGITS = 4; // digits of SHARED - 1
+
+struct Table {
+    char digits[SHARED][SHARED_DIGITS];
+    uint8_t length[SHARED];
+};
+
+constexpr Table build() {
+    Table table{};
+    for(int64_t v=0; v<SHARED; v++) {
+        char reversed[SHARED_DIGITS] = {};
+        uint8_t n = 0;
+        int64_t rest = v;
+        do {
+            reversed[n++] = static_cast<char>('0' + rest % 10);
+            rest /= 10;
+        } while(rest);
+        for(uint8_t i=0; i<n; i++) table.digits[v][i] = reversed[n - 1 - i];
+        table.length[v] = n;
+    }
+    return table;
+}
+
+inline constexpr Table TABLE = build();
+
+} // namespace integer_text_detail
+
+class IntegerText {
+public:
+    static constexpr int64_t SHARED = integer_text_detail::SHARED;
+
+private:
+    char buf_[20]; // "-9223372036854775808"
+    const char *data_;
+    size_t size_;
+
+public:
+    explicit IntegerText(int64_t v) {
+        if(v >= 0 && v < SHARED) {
+            data_ = integer_text_detail::TABLE.digits[v];
+            size_ = integer_text_detail::TABLE.length[v];
+            return;
+        }
+        auto [end, ec] = std::to_chars(buf_, buf_ + sizeof(buf_), v);
+        (void)ec; // 20 bytes fit every int64
+        data_ = buf_;
+        size_ = static_cast<size_t>(end - buf_);
+    }
+
+    // data_ may point into buf_
+    IntegerText(const IntegerText &) = delete;
+    IntegerText &operator=(const IntegerText &) = delete;
+
+    std::string_view view() const { return {data_, size_}; }
+    bool shared() const { return data_ != buf_; }
+};
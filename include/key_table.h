@@ -0,0 +1,583 @@
+#pragma once
+
+#include "epoch.h"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*
+ * Open-addressing hash index in the Swiss-table style.
+ *
+ * Slots are grouped 16 at a time; each group stores one control byte per
+ * slot followed by the 16 entry pointers. A group is 144 bytes and so spans
+ * three cache lines: a probe reads the control bytes, then only the lines
+ * of the pointers whose control byte matches. A control byte is EMPTY (0), DELETED (1), or the low 7 bits of
+ * the key's hash with the top bit set (H2). Lookups compare H2 against a whole group at once
+ * (one SSE2 compare when available) and only dereference entries whose H2
+ * matches, which filters out ~127/128 of false candidates.
+ *
+ * The table stores pointers and never owns entries: callers allocate and
+ * free them. KeyOf maps an entry to its key.
+ *
+ * One writer at a time (the caller serialises them) may run alongside any
+ * number of findShared() readers. Every control byte and slot store that
+ * readers can see is atomic, a slot is written before its control byte,
+ * and group arrays a resize drops are retired through epoch reclamation
+ * rather than freed. The writer's own reads stay plain.
+ */
+
+namespace key_table_detail {
+
+// Zero is EMPTY so freshly calloc'd groups need no initialisation
+constexpr int8_t CTRL_EMPTY = 0;
+constexpr int8_t CTRL_DELETED = 1;
+constexpr size_t GROUP_WIDTH = 16;
+
+// Bitmask of slots in one group whose control byte matches a condition
+class GroupMatcher {
+private:
+    const int8_t *ctrl_;
+
+public:
+    explicit GroupMatcher(const int8_t *ctrl) : ctrl_(ctrl) {}
+
+#if defined(__SSE2__)
+    uint32_t match(int8_t h2) const {
+        __m128i ctrl = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ctrl_));
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), ctrl)));
+    }
+
+    uint32_t matchEmpty() const { return match(CTRL_EMPTY); }
+
+    // full slots are the only negative control bytes
+    uint32_t matchEmptyOrDeleted() const {
+        __m128i ctrl = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ctrl_));
+        return ~static_cast<uint32_t>(_mm_movemask_epi8(ctrl)) & 0xFFFFu;
+    }
+#else
+    uint32_t match(int8_t h2) const {
+        uint32_t mask = 0;
+        for(size_t i=0; i<GROUP_WIDTH; i++) mask |= static_cast<uint32_t>(ctrl_[i] == h2) << i;
+        return mask;
+    }
+
+    uint32_t matchEmpty() const { return match(CTRL_EMPTY); }
+
+    uint32_t matchEmptyOrDeleted() const {
+        uint32_t mask = 0;
+        for(size_t i=0; i<GROUP_WIDTH; i++) mask |= static_cast<uint32_t>(ctrl_[i] >= 0) << i;
+        return mask;
+    }
+#endif
+};
+
+inline size_t lowestBit(uint32_t mask) { return static_cast<size_t>(__builtin_ctz(mask)); }
+
+} // namespace key_table_detail
+
+template <typename Entry, typename KeyOf>
+class KeyTable {
+private:
+    using Matcher = key_table_detail::GroupMatcher;
+    static constexpr size_t GROUP_WIDTH = key_table_detail::GROUP_WIDTH;
+    static constexpr int8_t CTRL_EMPTY = key_table_detail::CTRL_EMPTY;
+    static constexpr int8_t CTRL_DELETED = key_table_detail::CTRL_DELETED;
+
+    // Groups of the old table moved by each insert or erase while resizing
+    static constexpr size_t MIGRATE_GROUPS_PER_OP = 1;
+    // Tables smaller than this are still resized in one go
+    static constexpr size_t INCREMENTAL_MIN_GROUPS = 64;
+
+    struct Group {
+        int8_t ctrl[GROUP_WIDTH];
+        Entry *slots[GROUP_WIDTH];
+    };
+
+    // Zero-filled group array. For large tables calloc hands back untouched
+    // pages, so starting a resize doesn't write the whole new table.
+    class Groups {
+    private:
+        Group *data_ = nullptr;
+        size_t count_ = 0;
+
+    public:
+        Groups() = default;
+        explicit Groups(size_t count)
+            : data_(static_cast<Group *>(std::calloc(count, sizeof(Group)))), count_(count) {
+            if(!data_) throw std::bad_alloc();
+        }
+        ~Groups() { std::free(data_); }
+
+        Groups(Groups &&other) noexcept : data_(other.data_), count_(other.count_) {
+            other.data_ = nullptr;
+            other.count_ = 0;
+        }
+        Groups &operator=(Groups &&other) noexcept {
+            if(this != &other) {
+                std::free(data_);
+                data_ = std::exchange(other.data_, nullptr);
+                count_ = std::exchange(other.count_, 0);
+            }
+            return *this;
+        }
+
+        size_t size() const { return count_; }
+        bool empty() const { return count_ == 0; }
+        Group *data() const { return data_; }
+
+        // Give up the array without freeing it
+        Group *release() {
+            count_ = 0;
+            return std::exchange(data_, nullptr);
+        }
+        Group &operator[](size_t i) { return data_[i]; }
+        const Group &operator[](size_t i) const { return data_[i]; }
+    };
+
+    struct Pos {
+        size_t group;
+        size_t slot;
+        bool found() const { return group != NONE; }
+    };
+    static constexpr size_t NONE = static_cast<size_t>(-1);
+
+    /*
+     * A resize never stops the world. The current table moves to old_, a
+     * fresh groups_ takes every new insert, and old_ is drained a few groups
+     * at a time by later inserts/erases and by rehashStep(). Until it is
+     * empty, lookups check both tables.
+     */
+    Groups groups_;
+    Groups old_;
+    size_t migrate_pos_ = 0;  // next group of old_ to move
+    size_t size_ = 0;         // entries in both tables
+    size_t growth_left_ = 0;  // EMPTY slots of groups_ that may still be filled
+
+    // What findShared() probes: both tables, replaced as one pointer
+    struct View {
+        const Group *groups;
+        size_t group_count;
+        const Group *old;
+        size_t old_count;
+    };
+    std::atomic<View *> view_{nullptr};
+    epoch::RetireList retired_; // views and group arrays readers may still use
+
+    static void storeCtrl(Group &group, size_t slot, int8_t ctrl) {
+        std::atomic_ref<int8_t>(group.ctrl[slot]).store(ctrl, std::memory_order_release);
+    }
+    static void storeSlot(Entry *&slot, Entry *entry) {
+        std::atomic_ref<Entry *>(slot).store(entry, std::memory_order_release);
+    }
+
+    // Call after groups_ or old_ changed, before retiring a dropped array
+    void publishView() {
+        View *next = groups_.empty() ? nullptr
+                                     : new View{groups_.data(), groups_.size(), old_.data(), old_.size()};
+        View *prev = view_.exchange(next, std::memory_order_acq_rel);
+        if(prev) retired_.retire(prev, [](void *, void *view) { delete static_cast<View *>(view); });
+    }
+
+    void retireGroups(Groups groups) {
+        if(!groups.empty()) retired_.retire(groups.release(), [](void *, void *data) { std::free(data); });
+    }
+
+    static Entry *findSharedIn(const Group *groups, size_t count, std::string_view key, size_t hash) {
+        size_t mask = count - 1;
+        size_t g = h1(hash) & mask;
+        const int8_t tag = h2(hash);
+        for(size_t step=0; step<count; step++) {
+            const Group &group = groups[g];
+            int8_t ctrl[GROUP_WIDTH];
+            for(size_t i=0; i<GROUP_WIDTH; i++) {
+                ctrl[i] = std::atomic_ref<int8_t>(const_cast<int8_t &>(group.ctrl[i])).load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            Matcher matcher(ctrl);
+            for(uint32_t m = matcher.match(tag); m; m &= m - 1) {
+                size_t i = key_table_detail::lowestBit(m);
+                Entry *entry = std::atomic_ref<Entry *>(const_cast<Entry *&>(group.slots[i])).load(std::memory_order_acquire);
+                // null: a slot claimed by insertSlot() and not yet published
+                if(entry && KeyOf{}(entry) == key) return entry;
+            }
+            if(matcher.matchEmpty()) return nullptr;
+            g = (g + step + 1) & mask;
+        }
+        return nullptr;
+    }
+
+    static size_t hashKey(std::string_view key) { return std::hash<std::string_view>{}(key); }
+    static int8_t h2(size_t hash) { return static_cast<int8_t>((hash & 0x7F) | 0x80); }
+    static size_t h1(size_t hash) { return hash >> 7; }
+
+    // Load factor 7/8
+    static size_t maxLoad(size_t capacity) { return capacity - capacity / 8; }
+
+    // Triangular probing over a power-of-two number of groups visits every
+    // group. visit(g) returns true to stop.
+    template <typename Visit>
+    static void probe(const Groups &groups, size_t hash, Visit visit) {
+        if(groups.empty()) return;
+        size_t mask = groups.size() - 1;
+        size_t g = h1(hash) & mask;
+        for(size_t step=0; step<groups.size(); step++) {
+            if(visit(g)) return;
+            g = (g + step + 1) & mask;
+        }
+    }
+
+    static Pos findIn(const Groups &groups, std::string_view key, size_t hash) {
+        Pos pos{NONE, 0};
+        const int8_t tag = h2(hash);
+        probe(groups, hash, [&](size_t g) {
+            const Group &group = groups[g];
+            Matcher matcher(group.ctrl);
+            for(uint32_t m = matcher.match(tag); m; m &= m - 1) {
+                size_t i = key_table_detail::lowestBit(m);
+                if(KeyOf{}(group.slots[i]) == key) {
+                    pos = {g, i};
+                    return true;
+                }
+            }
+            // an EMPTY slot ends the probe sequence: the key was never pushed further
+            return matcher.matchEmpty() != 0;
+        });
+        return pos;
+    }
+
+    static Pos findFreeIn(const Groups &groups, size_t hash) {
+        Pos pos{NONE, 0};
+        probe(groups, hash, [&](size_t g) {
+            uint32_t m = Matcher(groups[g].ctrl).matchEmptyOrDeleted();
+            if(!m) return false;
+            pos = {g, key_table_detail::lowestBit(m)};
+            return true;
+        });
+        return pos;
+    }
+
+    bool migrating() const { return !old_.empty(); }
+
+    // Move up to count groups of old_ into groups_. Room for them was
+    // reserved when the resize started, so this never touches growth_left_.
+    size_t migrate(size_t count) {
+        size_t moved = 0;
+        for(; count && migrate_pos_ < old_.size(); count--) {
+            Group &group = old_[migrate_pos_++];
+            for(size_t i=0; i<GROUP_WIDTH; i++) {
+                if(group.ctrl[i] >= 0) continue;
+                size_t hash = hashKey(KeyOf{}(group.slots[i]));
+                Pos pos = findFreeIn(groups_, hash);
+                storeSlot(groups_[pos.group].slots[pos.slot], group.slots[i]);
+                storeCtrl(groups_[pos.group], pos.slot, h2(hash));
+                // a tombstone keeps old_ probe sequences running past this
+                // group; it lands after the copy, so readers that check old_
+                // first never miss the entry
+                storeCtrl(group, i, CTRL_DELETED);
+                moved++;
+            }
+        }
+        if(migrate_pos_ == old_.size()) {
+            Groups drained = std::move(old_);
+            migrate_pos_ = 0;
+            publishView();
+            retireGroups(std::move(drained));
+        }
+        return moved;
+    }
+
+    void finishMigration() {
+        if(migrating()) migrate(old_.size());
+    }
+
+    void startResize(size_t capacity) {
+        finishMigration();
+        old_ = std::move(groups_);
+        groups_ = Groups(capacity / GROUP_WIDTH);
+        migrate_pos_ = 0;
+        growth_left_ = maxLoad(capacity) - size_;
+        publishView();
+        if(old_.size() < INCREMENTAL_MIN_GROUPS) finishMigration();
+    }
+
+    // Out of EMPTY slots: drop tombstones at the same size if they are the
+    // problem, else double
+    void grow() {
+        finishMigration();
+        size_t cap = capacity();
+        if(cap == 0) cap = GROUP_WIDTH;
+        else if(size_ + 1 > maxLoad(cap) / 2) cap *= 2;
+        startResize(cap);
+    }
+
+    void eraseAt(Pos pos) {
+        Group &group = groups_[pos.group];
+        // a group that still has an EMPTY slot never overflowed, so no probe
+        // sequence runs through it and the slot can become EMPTY again
+        if(Matcher(group.ctrl).matchEmpty()) {
+            storeCtrl(group, pos.slot, CTRL_EMPTY);
+            growth_left_++;
+        } else {
+            storeCtrl(group, pos.slot, CTRL_DELETED);
+        }
+        size_--;
+    }
+
+    void eraseOldAt(Pos pos) {
+        storeCtrl(old_[pos.group], pos.slot, CTRL_DELETED);
+        size_--;
+    }
+
+    // Iteration walks groups_ and then old_ as one index space
+    size_t slotCount() const { return (groups_.size() + old_.size()) * GROUP_WIDTH; }
+    Pos posAt(size_t index) const {
+        size_t g = index / GROUP_WIDTH;
+        return {g < groups_.size() ? g : g - groups_.size(), index % GROUP_WIDTH};
+    }
+    const Group &groupAt(size_t index) const {
+        size_t g = index / GROUP_WIDTH;
+        return g < groups_.size() ? groups_[g] : old_[g - groups_.size()];
+    }
+    Group &groupAt(size_t index) {
+        size_t g = index / GROUP_WIDTH;
+        return g < groups_.size() ? groups_[g] : old_[g - groups_.size()];
+    }
+
+public:
+    template <bool Const>
+    class Iter {
+    private:
+        friend class KeyTable;
+        using Table = std::conditional_t<Const, const KeyTable, KeyTable>;
+
+        Table *table_;
+        size_t index_;
+
+        void skipFree() {
+            while(index_ < table_->slotCount() && table_->groupAt(index_).ctrl[index_ % GROUP_WIDTH] >= 0) index_++;
+        }
+
+    public:
+        Iter(Table *table, size_t index) : table_(table), index_(index) { skipFree(); }
+
+        Entry *operator*() const { return table_->groupAt(index_).slots[index_ % GROUP_WIDTH]; }
+        Iter &operator++() {
+            index_++;
+            skipFree();
+            return *this;
+        }
+        bool operator==(const Iter &other) const { return index_ == other.index_; }
+        bool operator!=(const Iter &other) const { return index_ != other.index_; }
+    };
+
+    // Iterators stay valid across erase(iterator) but not across
+    // insertSlot() or erase(key), which may move entries between tables.
+    using iterator = Iter<false>;
+    using const_iterator = Iter<true>;
+
+    KeyTable() = default;
+    ~KeyTable() { delete view_.load(std::memory_order_relaxed); }
+    KeyTable(const KeyTable &) = delete;
+    KeyTable &operator=(const KeyTable &) = delete;
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    size_t capacity() const { return groups_.size() * GROUP_WIDTH; }
+    bool rehashing() const { return migrating(); }
+
+    // Bytes used by the index itself (entries not included)
+    size_t memoryUsage() const { return (groups_.size() + old_.size()) * sizeof(Group); }
+
+    iterator begin() { return iterator(this, 0); }
+    iterator end() { return iterator(this, slotCount()); }
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, slotCount()); }
+
+    Entry *find(std::string_view key) const {
+        size_t hash = hashKey(key);
+        Pos pos = findIn(groups_, key, hash);
+        if(pos.found()) return groups_[pos.group].slots[pos.slot];
+        if(migrating()) {
+            pos = findIn(old_, key, hash);
+            if(pos.found()) return old_[pos.group].slots[pos.slot];
+        }
+        return nullptr;
+    }
+
+    // Lookup that may run while a writer changes the table. The caller
+    // holds an epoch::Guard, which keeps the entry found (provided the
+    // writer retires entries too) and the probed arrays alive until it ends.
+    Entry *findShared(std::string_view key) const {
+        size_t hash = hashKey(key);
+        const View *view = view_.load(std::memory_order_acquire);
+        while(view) {
+            // old_ first: migration copies into groups_ before it tombstones
+            // old_, so an entry missed in old_ is already in groups_
+            if(view->old_count) {
+                if(Entry *entry = findSharedIn(view->old, view->old_count, key, hash)) return entry;
+            }
+            if(Entry *entry = findSharedIn(view->groups, view->group_count, key, hash)) return entry;
+
+            // A resize that began after we loaded the view may have moved the
+            // key on from the arrays we probed. Its view was published before
+            // any such move, so a changed pointer here catches it.
+            const View *latest = view_.load(std::memory_order_acquire);
+            if(latest == view) return nullptr;
+            view = latest;
+        }
+        return nullptr;
+    }
+
+    // Store into a slot from insertSlot() or scan() where readers can see it
+    static void publish(Entry *&slot, Entry *entry) { storeSlot(slot, entry); }
+
+    // Free retired arrays no reader can still be probing
+    size_t reclaim() { return retired_.reclaim(); }
+
+    // Returns the slot holding key, or claims a fresh slot for it.
+    // second is true for a fresh slot, which the caller must fill with an
+    // entry whose key equals key before touching the table again.
+    std::pair<Entry **, bool> insertSlot(std::string_view key) {
+        size_t hash = hashKey(key);
+        if(migrating()) migrate(MIGRATE_GROUPS_PER_OP);
+
+        Pos pos = findIn(groups_, key, hash);
+        if(pos.found()) return {&groups_[pos.group].slots[pos.slot], false};
+        if(migrating()) {
+            pos = findIn(old_, key, hash);
+            if(pos.found()) return {&old_[pos.group].slots[pos.slot], false};
+        }
+
+        pos = findFreeIn(groups_, hash);
+        if(!pos.found() || (growth_left_ == 0 && groups_[pos.group].ctrl[pos.slot] == CTRL_EMPTY)) {
+            grow();
+            pos = findFreeIn(groups_, hash);
+        }
+
+        Group &group = groups_[pos.group];
+        if(group.ctrl[pos.slot] == CTRL_EMPTY) growth_left_--;
+        storeSlot(group.slots[pos.slot], nullptr);
+        storeCtrl(group, pos.slot, h2(hash));
+        size_++;
+        return {&group.slots[pos.slot], true};
+    }
+
+    // Remove key; returns its entry (for the caller to free) or nullptr
+    Entry *erase(std::string_view key) {
+        size_t hash = hashKey(key);
+        if(migrating()) migrate(MIGRATE_GROUPS_PER_OP);
+
+        Pos pos = findIn(groups_, key, hash);
+        if(pos.found()) {
+            Entry *entry = groups_[pos.group].slots[pos.slot];
+            eraseAt(pos);
+            return entry;
+        }
+        if(migrating()) {
+            pos = findIn(old_, key, hash);
+            if(pos.found()) {
+                Entry *entry = old_[pos.group].slots[pos.slot];
+                eraseOldAt(pos);
+                return entry;
+            }
+        }
+        return nullptr;
+    }
+
+    // Remove the entry at it; returns the iterator to the next entry
+    iterator erase(iterator it) {
+        Pos pos = posAt(it.index_);
+        if(it.index_ < capacity()) eraseAt(pos);
+        else eraseOldAt(pos);
+        ++it;
+        return it;
+    }
+
+    // Move up to groups groups of a resize in progress (for idle ticks).
+    // Returns the number of entries moved.
+    size_t rehashStep(size_t groups) {
+        return migrating() ? migrate(groups) : 0;
+    }
+
+    // Eviction sampling: walk from slot start (wrapping around) handing
+    // entries to fn until it has accepted count of them (fn returns true) or
+    // max_slots slots were looked at. Returns the number accepted.
+    template <typename Fn>
+    size_t sample(size_t start, size_t count, size_t max_slots, Fn fn) const {
+        size_t slots = slotCount();
+        if(size_ == 0) return 0;
+        size_t accepted = 0;
+        size_t index = start % slots;
+        for(size_t step = 0; step < std::min(slots, max_slots) && accepted < count; step++) {
+            const Group &group = groupAt(index);
+            size_t slot = index % GROUP_WIDTH;
+            if(group.ctrl[slot] < 0 && fn(static_cast<const Entry *>(group.slots[slot]))) accepted++;
+            if(++index == slots) index = 0;
+        }
+        return accepted;
+    }
+
+    // Visit up to count slots from cursor, handing fn each occupied slot so
+    // it can swap in an entry with the same key (defrag relocation). Returns
+    // the cursor to resume from, 0 once the end is reached. A resize between
+    // calls may make a resumed scan skip or revisit some entries.
+    template <typename Fn>
+    size_t scan(size_t cursor, size_t count, Fn fn) {
+        size_t end = std::min(slotCount(), cursor + count);
+        for(; cursor < end; cursor++) {
+            Group &group = groupAt(cursor);
+            size_t slot = cursor % GROUP_WIDTH;
+            if(group.ctrl[slot] < 0) fn(group.slots[slot]);
+        }
+        return cursor < slotCount() ? cursor : 0;
+    }
+
+    // Forget every entry (the caller frees them) and release the index
+    void clear() {
+        Groups groups = std::move(groups_);
+        Groups old = std::move(old_);
+        migrate_pos_ = 0;
+        size_ = 0;
+        growth_left_ = 0;
+        publishView();
+        retireGroups(std::move(groups));
+        retireGroups(std::move(old));
+    }
+
+    // Take over other's entries and index in one step, leaving other empty.
+    // This table's entries are the caller's to free; its arrays are retired
+    // as in clear(). other must not have been read with findShared().
+    void replace(KeyTable &other) {
+        Groups groups = std::exchange(groups_, std::move(other.groups_));
+        Groups old = std::exchange(old_, std::move(other.old_));
+        migrate_pos_ = std::exchange(other.migrate_pos_, 0);
+        size_ = std::exchange(other.size_, 0);
+        growth_left_ = std::exchange(other.growth_left_, 0);
+        publishView();
+        other.publishView();
+        retireGroups(std::move(groups));
+        retireGroups(std::move(old));
+    }
+
+    // Size the table for count entries up front, synchronously
+    void reserve(size_t count) {
+        finishMigration();
+        size_t cap = GROUP_WIDTH;
+        while(maxLoad(cap) < count) cap *= 2;
+        if(cap <= capacity()) return;
+        startResize(cap);
+        finishMigration();
+    }
+};
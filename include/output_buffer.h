@@ -0,0 +1,79 @@
+#pragma once
+
+#include "blob.h"
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+// Fixed-size blocks shared by every connection's output buffer.
+// Released blocks are cached for reuse up to MAX_CACHED, the rest go back to the heap.
+class BlockPool {
+public:
+    static constexpr size_t BLOCK_SIZE = 16 * 1024;
+    static constexpr size_t MAX_CACHED = 1024;
+
+    // A block either holds bytes in data or, when blob is set, stands for
+    // bytes [start, end) of that blob, whose reference it owns
+    struct Block {
+        Block *next;
+        const Blob *blob;
+        size_t start; // first unsent byte
+        size_t end;   // one past the last written byte
+        char data[BLOCK_SIZE - 2 * sizeof(void *) - 2 * sizeof(size_t)];
+
+        const char *bytes() const { return blob ? blob->data() : data; }
+    };
+
+    static BlockPool &instance();
+
+    Block *acquire();
+    void release(Block *block);
+
+    size_t cached() const;
+
+private:
+    mutable std::mutex mtx_;
+    Block *free_ = nullptr;
+    size_t cached_ = 0;
+
+    BlockPool() = default;
+    ~BlockPool();
+};
+
+// Per-connection queue of pending reply bytes, stored as a chain of pooled blocks.
+// Replies are appended as they are produced and flushed when the socket is writable.
+// Large blobs are queued by reference and go out with the surrounding bytes in
+// one sendmsg(), never copied.
+class OutputBuffer {
+private:
+    BlockPool::Block *head_ = nullptr;
+    BlockPool::Block *tail_ = nullptr;
+    size_t size_ = 0;
+
+public:
+    OutputBuffer() = default;
+    ~OutputBuffer();
+
+    OutputBuffer(const OutputBuffer &) = delete;
+    OutputBuffer &operator=(const OutputBuffer &) = delete;
+
+    // Blobs smaller than this are copied: a copy is cheaper than a block of its own
+    static constexpr size_t REFERENCE_MIN = 4096;
+
+    void append(std::string_view data);
+    void append(BlobRef blob);
+
+    // Number of bytes waiting to be sent
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    // Send as much as the socket accepts without blocking.
+    // Returns false if the socket failed.
+    bool flush(int fd);
+
+    // Copy of the pending bytes (for transports that don't write to a socket)
+    std::string str() const;
+
+    void clear();
+};
@@ -4,24 +4,65 @@
 #include <thread>
 #include <vector>
 #include <atomic>
+#include <mutex>
 #include "storage.h"
 #include "command_parser.h"
+#include "session.h"
+#include "shm_transport.h"
+#include "output_buffer.h"
+#include "timing_wheel.h"
+
+struct ServerConfig {
+    // Per-client output buffer limits in bytes (0 disables a limit).
+    // Above the soft limit the server stops reading the client's commands and
+    // disconnects it if the backlog stays there for output_soft_seconds.
+    // Above the hard limit the client is disconnected immediately.
+    size_t output_soft_limit = 8 * 1024 * 1024;
+    int output_soft_seconds = 10;
+    size_t output_hard_limit = 64 * 1024 * 1024;
+
+    // Connection timeouts in seconds (0 disables).
+    // idle: no traffic in either direction; read: a started command line
+    // must be completed within this time, however slowly its bytes trickle in.
+    int idle_timeout_secs = 300;
+    int read_timeout_secs = 30;
+
+    // Keyspace options for each client's Storage (active defrag)
+    StorageOptions storage;
+};
 
 class Server {
 private:
     int port_;
     int server_sock_;
     std::atomic<bool> running_;
+    ServerConfig config_;
 
     std::vector<std::thread> client_threads_;
+    std::vector<std::thread::id> finished_clients_; // ready to be joined
+    std::mutex finished_mtx_;
+
+    // connection timeouts, advanced by the accept loop
+    TimingWheel timers_;
+
+    // shared-memory channels served next to the TCP listener
+    std::vector<std::string> shm_names_;
+    std::vector<ShmChannel*> shm_channels_; // currently open, closed on stop()
+    std::mutex shm_mtx_;
 
     void accept_clients();                  // Main loop for accepting clients
     void handle_client(int client_sock);    // Handle a single client
+    void handle_shm_client(const std::string &name); // Serve one shm channel
+    void reap_finished_clients();           // Join threads of disconnected clients
 
 public:
-    Server(int port);
+    Server(int port, const ServerConfig &config = ServerConfig());
     ~Server();
 
+    // Also serve same-host clients over shared memory segment /mini_redis.<name>
+    // Must be called before start()
+    void add_shm_channel(const std::string &name);
+
     void start();       // Start server
     void stop();        // Stop server gracefully
 };
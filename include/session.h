@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Per-connection state, created once when a client connects and handed to
+// its CommandParser. Keeps filesystem work off the command path: the data
+// directory is resolved up front and only created when something is written.
+class Session {
+private:
+    int id_;               // socket / channel descriptor
+    std::string data_dir_; // data/client_<id>, or data/shm_<channel>
+    bool dir_ready_ = false;
+    size_t output_limit_ = 0; // reply bytes a command may queue (0 = unbounded)
+
+public:
+    explicit Session(int id);
+
+    // A shared memory client: its data lives under the channel name, so it
+    // is found again on reconnect whatever descriptor the segment gets, and
+    // never mixes with a TCP client's.
+    Session(int id, std::string_view shm_channel);
+
+    int id() const { return id_; }
+
+    // The connection's output hard limit. Commands with bulky replies (SHOW,
+    // MGET) stop adding rows once the client's buffer is past it.
+    size_t outputLimit() const { return output_limit_; }
+    void setOutputLimit(size_t bytes) { output_limit_ = bytes; }
+    const std::string &dataDir() const { return data_dir_; }
+
+    // Create the data directory on first use; later calls are free.
+    // Returns false if it can't be created.
+    bool ensureDataDir();
+
+    // Path of a file inside the data directory
+    std::string dataPath(std::string_view filename) const;
+};
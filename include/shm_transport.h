@@ -0,0 +1,123 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/*
+ * Shared-memory transport for clients on the same host.
+ *
+ * A channel is one POSIX shared memory segment holding two single-producer/
+ * single-consumer byte rings: requests (client -> server) and replies
+ * (server -> client). Messages are written in place into the ring and the
+ * peer is woken through a futex word in the same segment, so a round trip
+ * never copies payload through the kernel.
+ */
+
+// Control block at the start of each ring. Producer and consumer fields live
+// on separate cache lines so the two sides don't false-share.
+struct ShmRingHeader {
+    alignas(64) std::atomic<uint64_t> head;        // bytes published by producer
+    alignas(64) std::atomic<uint64_t> tail;        // bytes consumed by consumer
+    alignas(64) std::atomic<uint32_t> data_seq;    // futex word: bumped on publish
+    std::atomic<uint32_t> data_waiters;
+    std::atomic<uint32_t> space_seq;               // futex word: bumped on consume
+    std::atomic<uint32_t> space_waiters;
+    std::atomic<uint32_t> closed;
+};
+
+// Non-owning view over a ring inside a mapped segment
+class ShmRing {
+public:
+    enum class ReadStatus { Ok, Closed, TimedOut };
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    ShmRingHeader *hdr_;
+    char *data_;
+    size_t capacity_; // power of two
+    const std::atomic<int32_t> *peer_pid_; // other end's process, 0 until known
+    bool partial_ = false; // read stopped inside a multi-frame message
+
+    ReadStatus waitForData(uint64_t tail, Clock::time_point deadline);
+    bool waitForSpace(uint64_t head, size_t need);
+    ReadStatus readUntil(std::string &out, Clock::time_point deadline);
+    bool peerGone();
+
+public:
+    ShmRing() : hdr_(nullptr), data_(nullptr), capacity_(0), peer_pid_(nullptr) {}
+    ShmRing(ShmRingHeader *hdr, char *data, size_t capacity, const std::atomic<int32_t> *peer_pid);
+
+    // Append one message; large messages are split into several frames.
+    // Blocks while the ring is full. Returns false once the ring is closed,
+    // which also happens when the peer process has exited.
+    bool write(std::string_view msg);
+
+    // Read the next complete message into out.
+    // Blocks while the ring is empty. Returns false once the ring is closed,
+    // which also happens when the peer process has exited.
+    bool read(std::string &out);
+
+    // Like read(), but gives up with TimedOut when nothing arrives within
+    // timeout. A message cut short by the timeout stays in out and is
+    // completed by the next call, which must pass the same string.
+    ReadStatus readFor(std::string &out, std::chrono::milliseconds timeout);
+
+    void close();
+    bool closed() const;
+};
+
+class ShmChannel {
+public:
+    enum class Mode { Create, Open };
+
+    static constexpr size_t DEFAULT_CAPACITY = 1 << 20; // per ring
+
+    // Create (server) or attach to (client) the segment /mini_redis.<name>.
+    // Throws std::runtime_error on failure.
+    ShmChannel(const std::string &name, Mode mode, size_t capacity = DEFAULT_CAPACITY);
+    ~ShmChannel();
+
+    ShmChannel(const ShmChannel &) = delete;
+    ShmChannel &operator=(const ShmChannel &) = delete;
+
+    ShmRing &requests() { return requests_; }
+    ShmRing &replies() { return replies_; }
+
+    // Closes both directions and wakes any blocked peer
+    void close();
+
+    // Whether a client has attached to the channel
+    bool attached() const;
+
+    // Segment descriptor, unique within the process while the channel is open
+    int fd() const { return fd_; }
+
+private:
+    std::string path_;
+    Mode mode_;
+    int fd_;
+    void *base_;
+    size_t mapped_size_;
+    ShmRing requests_;
+    ShmRing replies_;
+};
+
+// Minimal blocking client for the shared-memory transport
+class ShmClient {
+private:
+    ShmChannel channel_;
+    std::string reply_;
+
+public:
+    explicit ShmClient(const std::string &name);
+    ~ShmClient();
+
+    // Send one command line and wait for its reply.
+    // Throws std::runtime_error if the server closed the channel.
+    const std::string &execute(std::string_view command);
+};
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * Size-classed slab allocator for keyspace entries.
+ *
+ * Memory is taken from the system in 64KB slabs aligned to their own size.
+ * Each slab is cut into equal chunks of one size class and keeps its own
+ * free list, so a chunk finds its slab by masking its address. Slabs with
+ * free chunks sit on their class's partial list; when a slab's last chunk
+ * is freed the slab goes back to the system, except for one empty slab
+ * per class that is kept to absorb churn. Requests above MAX_CHUNK go
+ * straight to operator new.
+ *
+ * Defragmentation: beginDrain() marks the sparsest slabs of fragmented
+ * classes as draining. Draining slabs get no new allocations, so an owner
+ * that moves every chunk for which draining() is true (allocate a new
+ * chunk, copy, free the old one) empties them and they are released.
+ *
+ * Not thread-safe: Storage only calls it while holding its own lock.
+ */
+class SlabAllocator {
+public:
+    static constexpr size_t SLAB_SIZE = 64 * 1024;
+    static constexpr size_t MAX_CHUNK = 8192;
+
+    // 16-byte steps up to 128, then four classes per power of two
+    static constexpr size_t sizeClass(size_t n) {
+        if(n <= 128) return n ? (n + 15) & ~size_t(15) : 16;
+        size_t p = 128;
+        while(p * 2 < n) p *= 2;
+        size_t step = p / 4;
+        return (n + step - 1) / step * step;
+    }
+
+    struct ClassStats {
+        size_t chunk_size;
+        size_t slabs;
+        size_t chunks_used;
+        size_t chunks_free; // unused chunks inside this class's slabs
+        size_t draining;
+    };
+
+    struct Stats {
+        std::vector<ClassStats> classes; // classes that currently own slabs
+        size_t slab_bytes = 0;           // memory held in slabs
+        size_t used_bytes = 0;           // bytes handed out from slabs
+        size_t large_allocs = 0;         // live allocations above MAX_CHUNK
+        size_t large_bytes = 0;
+    };
+
+    SlabAllocator();
+    ~SlabAllocator();
+
+    SlabAllocator(const SlabAllocator &) = delete;
+    SlabAllocator &operator=(const SlabAllocator &) = delete;
+
+    // size is rounded up to its class; deallocate must get the same size
+    void *allocate(size_t size);
+    void deallocate(void *p, size_t size);
+
+    Stats stats() const;
+
+    // Bytes handed out and not yet freed (class sizes plus large requests)
+    size_t allocatedBytes() const { return allocated_bytes_; }
+
+    // Memory held in slabs and the part of it handed out. Kept up to date
+    // on every call, so unlike stats() these never walk the slabs.
+    size_t slabBytes() const { return slab_bytes_; }
+    size_t slabUsedBytes() const { return allocated_bytes_ - large_bytes_; }
+
+    // Mark slabs filled below fill_pct for draining, in classes with at least
+    // a whole slab's worth of free chunks, sparsest first and no more than
+    // that waste can absorb. Returns the number of slabs marked.
+    size_t beginDrain(unsigned fill_pct);
+
+    // Whether the chunk at p should be moved out of its slab
+    bool draining(const void *p, size_t size) const;
+
+    // Stop draining; slabs that still hold chunks take allocations again
+    void endDrain();
+
+private:
+    struct Slab;
+
+    struct SizeClass {
+        size_t chunk_size = 0;
+        Slab *slabs = nullptr;   // every slab of this class
+        Slab *partial = nullptr; // slabs with at least one free chunk
+        Slab *spare = nullptr;   // one fully free slab kept for reuse
+        size_t slab_count = 0;
+        size_t used = 0;
+        size_t capacity = 0;
+    };
+
+    std::vector<SizeClass> classes_;
+    std::vector<uint8_t> class_of_; // (size + 15) / 16 -> class index
+    size_t large_allocs_ = 0;
+    size_t large_bytes_ = 0;
+    size_t allocated_bytes_ = 0;
+    size_t slab_bytes_ = 0;
+
+    Slab *newSlab(size_t cls);
+    void releaseSlab(Slab *slab);
+};
@@ -1,66 +1,296 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include "entry.h"
+#include "epoch.h"
+#include "key_table.h"
+#include "slab_allocator.h"
 #include <optional>
+#include <span>
+#include <vector>
+#include <random>
 #include <mutex>
+#include <shared_mutex>
 #include <atomic>
 #include <thread>
+#include <chrono>
 #include <variant>
 #include <nlohmann/json.hpp> // for json 
 
 using json = nlohmann::json;
 
+enum class EvictionPolicy {
+    NoEviction,  // refuse writes once maxmemory is reached
+    AllKeysLru,  // least recently used key
+    VolatileLru, // least recently used key among those with a TTL
+    AllKeysLfu,  // least frequently used key
+    VolatileTtl, // key with the nearest expiry
+};
+
+// Redis-style names ("allkeys-lru", ...); parse returns nullopt for unknown ones
+std::optional<EvictionPolicy> parseEvictionPolicy(std::string_view name);
+const char *evictionPolicyName(EvictionPolicy policy);
+
+// How get() and exists() are protected against writers
+enum class ReadMode {
+    LockFree,  // epoch-guarded probe, no lock at all
+    Shared,    // shared lock: readers run together, writers wait them out
+    Exclusive, // the writer lock, one operation at a time
+};
+
+// "lockfree", "shared", "exclusive"; parse returns nullopt for unknown ones
+std::optional<ReadMode> parseReadMode(std::string_view name);
+const char *readModeName(ReadMode mode);
+
+struct StorageOptions {
+    // Active defragmentation: the cleaner thread moves entries out of sparse
+    // slabs into denser ones so the emptied slabs can go back to the system.
+    // A cycle starts once at least defrag_ignore_bytes of slab memory is free
+    // and that is at least defrag_threshold_pct of all slab memory; it drains
+    // slabs filled below defrag_slab_fill_pct. Each cleaner tick (100ms) may
+    // spend defrag_cpu_pct percent of it relocating.
+    bool active_defrag = true;
+    size_t defrag_ignore_bytes = 1024 * 1024;
+    unsigned defrag_threshold_pct = 10;
+    unsigned defrag_slab_fill_pct = 50;
+    unsigned defrag_cpu_pct = 5;
+
+    // Memory bound for entries plus the index, in bytes (0 = unbounded).
+    // It holds per Storage, i.e. per client: each keyspace gets the whole
+    // limit, and nothing bounds their sum.
+    // A write over the limit first evicts keys chosen by eviction_policy:
+    // each round samples eviction_samples random keys into a small pool of
+    // the best candidates (approximate LRU/LFU, no per-access list upkeep).
+    // Under noeviction, or with nothing left to evict, the write fails.
+    size_t maxmemory = 0;
+    EvictionPolicy eviction_policy = EvictionPolicy::NoEviction;
+    unsigned eviction_samples = 5;
+    // LFU: how slowly the logarithmic counter grows, and the idle minutes
+    // after which it is decremented once
+    unsigned lfu_log_factor = 10;
+    unsigned lfu_decay_minutes = 1;
+
+    // Lookup path for get()/exists(). Lock-free scales best; the locking
+    // modes are kept for comparison (bench/locking_bench.cpp).
+    ReadMode read_mode = ReadMode::LockFree;
+};
+
 class Storage {
 private:
-    using InternalValue = std::variant<int, double, std::string, bool>;
+    using InternalValue = std::variant<int64_t, double, std::string, bool>;
 
-    struct ValueEntry {
-        InternalValue value;
-        std::chrono::steady_clock::time_point expiry;
-        bool hasExpiry = false;
-    };
+    // Lookups take a std::string_view (e.g. a slice of a connection's input
+    // buffer) without building a std::string key. The table only indexes
+    // entries; Storage allocates and frees them.
+    //
+    // Writers hold mtx_ exclusively; dump(), saveToFile() and the other
+    // read-only walks hold it shared. get() and exists() by default take no
+    // lock: they probe map_ under an epoch guard. A published entry is never
+    // changed except for its meta word, so an overwrite publishes a new
+    // entry and retires the old one, which is freed once no reader can
+    // still hold it.
+    mutable std::shared_mutex mtx_;
+    SlabAllocator slabs_; // owns every Entry; declared first so it outlives map_
+    BlobFreeList freed_blobs_; // slab blobs let go of, for reclaim() to free
+    size_t slab_blob_bytes_ = 0; // slab bytes held by blobs, counted via external_bytes_
+    KeyTable<Entry, EntryKey> map_;
+    epoch::RetireList retired_; // unlinked entries readers may still hold
+    size_t retired_bytes_ = 0;
+    size_t external_bytes_ = 0; // blobs and counters held by live entries
+    std::atomic<uint64_t> batch_seq_{0}; // odd while setMany() publishes a batch
+
+    StorageOptions options_;
+    bool defrag_running_ = false;
+    size_t defrag_cursor_ = 0; // next slot of map_ to look at
+    size_t expire_cursor_ = 0; // where the cleaner's expiry walk resumes
+    size_t defrag_cycles_ = 0;
+    size_t defrag_moved_ = 0;
 
-    mutable std::mutex mtx_;
-    std::unordered_map<std::string, ValueEntry> map_;
+    struct EvictionCandidate {
+        uint64_t score; // higher is evicted first
+        std::string key;
+    };
+    std::vector<EvictionCandidate> eviction_pool_; // ascending score, best last
+    std::mt19937_64 rng_;
+    size_t evicted_keys_ = 0;
     
     std::atomic<bool> stop_{false};
     std::thread cleaner_thread_;
 
     void cleaner(); // background cleanup loop
+    void upsert(std::string_view key, const CompactValue &value, uint64_t expiry_ms);
+    void upsert(KeyTable<Entry, EntryKey> &index, std::string_view key, const CompactValue &value, uint64_t expiry_ms);
+    void clearEntries();
+    Entry *createEntry(std::string_view key, const CompactValue &value, uint64_t meta);
+    void retire(Entry *entry);
+    void reclaim();
+    void eraseIfExpired(std::string_view key);
+    template <typename Fn>
+    size_t readEntries(std::span<const std::string_view> keys, Fn fn);
+    template <typename Fn>
+    bool readEntry(std::string_view key, Fn fn);
+    bool setExpiry(std::string_view key, uint64_t expiry_ms);
+    bool defragStart();
+    bool defragStep(std::chrono::steady_clock::time_point deadline);
+    void expireStep(std::chrono::steady_clock::time_point deadline);
+    size_t usedMemory() const;
+    uint32_t lfuCounter(const Entry *entry) const;
+    void touch(Entry *entry);
+    uint64_t evictionScore(const Entry *entry) const;
+    void fillEvictionPool(const KeyTable<Entry, EntryKey> &index);
+    bool evictIfNeeded();
+    bool evictFrom(KeyTable<Entry, EntryKey> &index, size_t outside_bytes);
 
 public:
-    Storage();
+    explicit Storage(const StorageOptions &options = StorageOptions());
     ~Storage();
 
     using Value = InternalValue; // public alias
 
     // Store a key-value pair
-    void set(const std::string &key, const Value &value);
-    void set(const std::string &key, const Value &value, int ttl_secs);
+    // Returns false if memory is over maxmemory and nothing could be evicted
+    bool set(std::string_view key, const Value &value);
+    bool set(std::string_view key, const Value &value, int ttl_secs);
 
     // Retrieve the value for a key
     // Returns std::nullopt if key does not exist
-    std::optional<Value> get(const std::string &key);
+    std::optional<Value> get(std::string_view key);
+
+    // Same, without copying large strings: they come back as a reference to
+    // the stored blob (CompactValue::blob()), valid after the key changes
+    // but not after the Storage is destroyed
+    std::optional<CompactValue> getRef(std::string_view key);
+
+    // Look up every key in one batch: one epoch guard, or one lock in the
+    // locking read modes. Results line up with keys; missing ones are nullopt.
+    std::vector<std::optional<CompactValue>> getMany(std::span<const std::string_view> keys);
+
+    enum class SetStatus {
+        Ok,
+        ConditionFailed, // a condition on the keys' existence didn't hold
+        OutOfMemory,     // over maxmemory and nothing could be evicted
+    };
+
+    // Set every pair (clearing TTLs) under one hold of the writer lock, so
+    // no other writer or reader, lock-free ones included, sees part of the
+    // batch. With only_if_none_exist, nothing is set if any key already
+    // exists.
+    // A key given twice ends up with its last value.
+    SetStatus setMany(std::span<const std::pair<std::string_view, Value>> pairs, bool only_if_none_exist = false);
+
+    // SET's options (NX/XX, EX/PX, KEEPTTL)
+    struct SetOptions {
+        enum class Condition {
+            Always,
+            IfMissing, // NX: only create the key
+            IfExists,  // XX: only replace it
+        };
+        Condition condition = Condition::Always;
+        std::optional<int64_t> ttl_ms; // TTL of the new value; none clears the key's TTL
+        bool keep_ttl = false;         // keep the key's current TTL instead
+    };
+
+    // Conditional set, checked and applied under one hold of the writer
+    // lock. If old is given it receives the key's previous value (nullopt
+    // if there was none), whether or not the condition held.
+    SetStatus set(std::string_view key, const Value &value, const SetOptions &options,
+                  std::optional<CompactValue> *old = nullptr);
+
+    // Replace the value only if it currently equals expected (same type
+    // and value). The key keeps its TTL. ConditionFailed if it differs or
+    // the key is missing.
+    SetStatus compareAndSet(std::string_view key, const Value &expected, const Value &value);
+
+    // Delete a key and return the value it had, nullopt if it didn't exist
+    std::optional<CompactValue> getDel(std::string_view key);
 
     // Delete a key
-    // Returns true if deleted, false if key did not exist
-    bool del(const std::string &key);
+    // Returns true if deleted, false if key did not exist (or had expired)
+    bool del(std::string_view key);
 
     // Check if a key exists
-    bool exists(const std::string &key);
+    bool exists(std::string_view key);
 
     // Get the number of stored key-value pairs
     size_t size() const;
 
+    // Outcome of an increment; the key is left as it was unless Ok
+    enum class IncrStatus {
+        Ok,
+        NotNumber,   // the value isn't an integer (incrBy) or a number (incrByFloat)
+        Overflow,    // the result doesn't fit int64, or isn't finite
+        OutOfMemory, // over maxmemory and nothing could be evicted
+    };
+
+    // Atomically add delta to the number at key and store the sum in result.
+    // A missing key counts as 0; an existing key keeps its TTL.
+    IncrStatus incrBy(std::string_view key, int64_t delta, int64_t &result);
+    // An integer value becomes a double
+    IncrStatus incrByFloat(std::string_view key, double delta, double &result);
+
+    // Like incrBy, but keeps the value as a StripedCounter: once a key is a
+    // counter, increments from many threads go to per-thread cells without
+    // the writer lock or a shared cache line, and reads return the sum.
+    // GET, INCR and the rest see it as an ordinary integer; SET replaces it.
+    IncrStatus incrCounter(std::string_view key, int64_t delta, int64_t &result);
+
     // Set a TTL on an existing key (in seconds)
     // Return true if TTL was set/updated, false if key not found
-    bool expire(const std::string &key, int ttl_secs);
+    // A deadline that has already passed deletes the key.
+    bool expire(std::string_view key, int ttl_secs);
+    bool pexpire(std::string_view key, int64_t ttl_ms);
+    // Same, at an absolute Unix time in milliseconds
+    bool pexpireAt(std::string_view key, int64_t unix_ms);
+
+    // Remove a key's TTL; false if the key is missing or has none
+    bool persist(std::string_view key);
+
+    // Milliseconds the key has left, or one of these (as Redis's PTTL)
+    static constexpr int64_t TTL_NONE = -1;    // the key has no TTL
+    static constexpr int64_t TTL_MISSING = -2; // the key doesn't exist
+    int64_t pttl(std::string_view key);
 
     // Get a snapshot of all keys and values
     std::unordered_map<std::string, Value> dump() const;
 
+    // Walk the keyspace a batch at a time, like Redis's SCAN: fills batch
+    // with the live keys of up to count slots from cursor, under one hold of
+    // the shared lock, and returns the cursor to resume from (0 once done).
+    // Keys written between calls may be missed or seen twice.
+    size_t scan(size_t cursor, size_t count, std::vector<std::pair<std::string, CompactValue>> &batch);
+
+    struct MemoryStats {
+        SlabAllocator::Stats slabs; // per-size-class occupancy of the entry allocator
+        size_t defrag_cycles = 0;
+        size_t defrag_moved = 0;    // entries relocated by defrag so far
+        bool defrag_running = false;
+        size_t used_memory = 0;     // entries plus index, the figure maxmemory bounds
+        size_t maxmemory = 0;
+        EvictionPolicy eviction_policy = EvictionPolicy::NoEviction;
+        size_t evicted_keys = 0;
+    };
+    MemoryStats memoryStats() const;
+
+    // Bytes a key's entry occupies, or std::nullopt if the key doesn't exist
+    std::optional<size_t> memoryUsage(std::string_view key) const;
+
+    // Run a whole defrag cycle now, if the thresholds call for one.
+    // Returns the number of entries moved.
+    size_t defragment();
+
     // JSON persistence
     bool saveToFile(const std::string &filename) const;
-    bool loadFromFile(const std::string &filename);
+
+    enum class LoadStatus {
+        Ok,
+        FileError,   // the file couldn't be opened
+        OutOfMemory, // the data doesn't fit in maxmemory; the keyspace is left as it was
+    };
+    // Replaces the whole keyspace once the file has loaded. Keys are inserted
+    // like SETs into a fresh keyspace, so over maxmemory the policy evicts
+    // among the loaded keys to make room, and noeviction fails the load.
+    LoadStatus loadFromFile(const std::string &filename);
 };
\ No newline at end of file
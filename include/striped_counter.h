@@ -0,0 +1,159 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+/*
+ * Integer counter for keys that many threads bump at once.
+ *
+ * A plain counter is one cache line every incrementing core fights over.
+ * This one spreads the count over CELLS cache-line sized cells: each
+ * thread adds to its own cell (picked once per thread), so increments
+ * from different cores don't contend, and a read sums the cells.
+ *
+ * add() refuses a delta that would take the total past the int64 limits,
+ * leaving the count as it was, so sum() is always the exact total. While
+ * every cell stays within NARROW no total can get there and add() touches
+ * only its own cell; past that, each add checks the summed total.
+ * Nothing on the add path reads other cells while the counter is narrow,
+ * so the new total isn't known there: add() can report the count of the
+ * cell it landed in, and only sum() adds them all up.
+ * Reference-counted like Blob, so a value copy shares the counter and
+ * increments that found it lock-free stay valid until they are done.
+ */
+class StripedCounter {
+public:
+    static constexpr size_t MAX_CELLS = 64;
+
+private:
+    struct alignas(64) Cell {
+        std::atomic<int64_t> value{0};
+    };
+
+    // MAX_CELLS cells within +-NARROW can't add up past int64
+    static constexpr int64_t NARROW = INT64_MAX / MAX_CELLS;
+
+    mutable std::atomic<uint32_t> refs_{1};
+    std::atomic<bool> wide_{false}; // set for good once a cell may leave +-NARROW
+    size_t mask_;
+    std::unique_ptr<Cell[]> cells_;
+
+    // Each thread keeps the same cell for its lifetime; threads are dealt
+    // out round-robin so up to CELLS of them never share one
+    static size_t threadIndex() {
+        static std::atomic<size_t> next{0};
+        thread_local size_t index = next.fetch_add(1, std::memory_order_relaxed);
+        return index;
+    }
+
+    // One cell per hardware thread, as a power of two within [4, MAX_CELLS]
+    static size_t defaultCells() {
+        size_t want = std::max<size_t>(std::thread::hardware_concurrency(), 4);
+        size_t cells = 1;
+        while(cells < want && cells < MAX_CELLS) cells <<= 1;
+        return cells;
+    }
+
+    explicit StripedCounter(size_t cells) : mask_(cells - 1), cells_(new Cell[cells]) {}
+
+public:
+    StripedCounter(const StripedCounter &) = delete;
+    StripedCounter &operator=(const StripedCounter &) = delete;
+
+    // A counter starting at initial, owned by the caller (refcount 1).
+    // cells is rounded down to a power of two; 0 picks one per hardware thread.
+    // initial goes in the calling thread's cell, so while that thread is
+    // the only one adding, its cell holds the whole total.
+    static StripedCounter *create(int64_t initial = 0, size_t cells = 0) {
+        if(cells == 0) cells = defaultCells();
+        cells = std::min(cells, MAX_CELLS);
+        while(cells & (cells - 1)) cells &= cells - 1;
+        auto *counter = new StripedCounter(cells);
+        counter->cells_[threadIndex() & counter->mask_].value.store(initial, std::memory_order_relaxed);
+        counter->wide_.store(initial > NARROW || initial < -NARROW, std::memory_order_relaxed);
+        return counter;
+    }
+
+    void retain() const { refs_.fetch_add(1, std::memory_order_relaxed); }
+    void release() const {
+        if(refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) delete this;
+    }
+
+private:
+    // 64 cells of int64 can pass int64 on the way to the total
+    __extension__ typedef __int128 Wide;
+
+    // Sequentially consistent, like the adds and wide_, so an add that saw
+    // wide_ unset is either seen here or sees it set afterwards
+    Wide wideSum() const {
+        Wide total = 0;
+        for(size_t i=0; i<=mask_; i++) total += cells_[i].value.load();
+        return total;
+    }
+
+    static bool fits(Wide total) { return total >= INT64_MIN && total <= INT64_MAX; }
+
+    // Add delta to one cell unless that cell would overflow, or with
+    // narrow, leave +-NARROW. next gets the cell's new count.
+    static bool addToCell(std::atomic<int64_t> &cell, int64_t delta, bool narrow, int64_t &next) {
+        int64_t cur = cell.load(std::memory_order_relaxed);
+        do {
+            if(__builtin_add_overflow(cur, delta, &next)) return false;
+            if(narrow && (next > NARROW || next < -NARROW)) return false;
+        } while(!cell.compare_exchange_weak(cur, next));
+        return true;
+    }
+
+public:
+    // Returns false, changing nothing, if the total would leave int64.
+    // The delta goes to the thread's own cell, or to another one should
+    // that cell alone overflow. Adds racing at the limit each check the
+    // total after landing and take themselves back out if it went past.
+    // cell_count, if given, gets the new count of the cell the delta went
+    // to: the total only while a single thread adds (see create()).
+    bool add(int64_t delta, int64_t *cell_count = nullptr) {
+        size_t home = threadIndex() & mask_;
+        int64_t next;
+        if(!wide_.load()) {
+            std::atomic<int64_t> &cell = cells_[home].value;
+            if(addToCell(cell, delta, true, next)) {
+                if(cell_count) *cell_count = next;
+                if(!wide_.load() || fits(wideSum())) return true;
+                cell.fetch_sub(delta); // another add went wide meanwhile and the total is past
+                return false;
+            }
+            wide_.store(true);
+        }
+
+        if(!fits(wideSum() + delta)) return false;
+        for(size_t i=0; i<=mask_; i++) {
+            std::atomic<int64_t> &cell = cells_[(home + i) & mask_].value;
+            if(!addToCell(cell, delta, false, next)) continue;
+            if(cell_count) *cell_count = next;
+            if(fits(wideSum())) return true;
+            cell.fetch_sub(delta); // wraps back to what it was
+            return false;
+        }
+        return false;
+    }
+
+    // The total. It can only be past int64 for the moment between an add
+    // that went too far and its undo, so such a reading is taken again.
+    int64_t sum() const {
+        Wide total = wideSum();
+        while(!fits(total)) {
+            std::this_thread::yield();
+            total = wideSum();
+        }
+        return static_cast<int64_t>(total);
+    }
+
+    size_t cells() const { return mask_ + 1; }
+
+    // Heap bytes the counter takes up
+    size_t footprint() const { return sizeof(StripedCounter) + cells() * sizeof(Cell); }
+};
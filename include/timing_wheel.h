@@ -0,0 +1,64 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// Hashed timing wheel (Varghese & Lauck).
+// Timers hash into slots by expiry tick, so scheduling, rescheduling and
+// cancelling are O(1) no matter how many timers exist. advance() only
+// visits the slots whose tick has passed.
+class TimingWheel {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Intrusive timer node, owned by the caller (e.g. one per connection).
+    // The callback runs on the thread calling advance(), with the wheel
+    // locked, so it must be short and must not call back into the wheel.
+    class Timer {
+    private:
+        friend class TimingWheel;
+
+        TimingWheel &wheel_;
+        std::function<void()> on_expire_;
+        bool scheduled_ = false;
+        Timer *prev_ = nullptr;
+        Timer *next_ = nullptr;
+        size_t slot_ = 0;
+        size_t rounds_ = 0; // full revolutions left before firing
+
+    public:
+        Timer(TimingWheel &wheel, std::function<void()> on_expire)
+            : wheel_(wheel), on_expire_(std::move(on_expire)) {}
+        ~Timer() { wheel_.cancel(*this); } // also waits out a callback in progress
+
+        Timer(const Timer &) = delete;
+        Timer &operator=(const Timer &) = delete;
+    };
+
+    TimingWheel(Clock::duration tick, size_t slots, Clock::time_point start = Clock::now());
+
+    // (Re)arm a timer to fire after delay, rounded up to whole ticks
+    void schedule(Timer &timer, Clock::duration delay);
+
+    // Disarm a timer; no-op if it isn't scheduled
+    void cancel(Timer &timer);
+
+    // Fire every timer due at or before now. Returns the number fired.
+    size_t advance(Clock::time_point now);
+
+    Clock::duration tick() const { return tick_; }
+    size_t pending() const;
+
+private:
+    mutable std::mutex mtx_;
+    std::vector<Timer*> slots_;
+    Clock::duration tick_;
+    Clock::time_point last_tick_;
+    size_t cursor_ = 0;
+    size_t pending_ = 0;
+
+    void unlink(Timer &timer);
+};
@@ -1,12 +1,14 @@
 #include "command_parser.h"
-#include "../include/constants.h"
+#include "integer_text.h"
 #include <sstream>
 #include <cctype>
 #include <algorithm>
 #include <iostream>
 #include <iomanip>    // for setw, left
 #include <variant>
-#include <filesystem> // C++17 for folder management
+#include <charconv>   // from_chars
+#include <climits>
+#include <cmath>
 
 #define COLOR_RESET   "\033[0m"
 #define COLOR_GREEN   "\033[32m"
@@ -16,208 +18,766 @@
 #define COLOR_MAGENTA "\033[35m"
 
 
-CommandParser::CommandParser(Storage &s, int sock) : store(s), clientSock(sock) {}
+CommandParser::CommandParser(Storage &s, Session &sess) : store(s), session(sess) {}
 
-std::vector<std::string> CommandParser::tokenize(const std::string &line) {
-    std::vector<std::string> tokens;
-    std::string token;
-    bool inQuotes = false;
+void CommandParser::tokenize(std::string_view line, ArgVector &args) {
+    args.clear();
+    scratch_.clear();
 
-    for(size_t i=0; i<line.size(); i++) {
-        char ch = line[i];
+    auto isSpace = [](char ch) { return std::isspace(static_cast<unsigned char>(ch)) != 0; };
+    const size_t n = line.size();
+    size_t i = 0;
 
-        if(ch == '"') {
-            inQuotes = !inQuotes;
-            if(!inQuotes) {
-                tokens.push_back(token);
-                token.clear();
-            }
-        } else if(std::isspace(ch) && !inQuotes) {
-            if(!token.empty()) {
-                tokens.push_back(token);
-                token.clear();
+    while(i < n) {
+        if(isSpace(line[i])) {
+            i++;
+            continue;
+        }
+
+        // a token is an unquoted prefix, optionally followed by a quoted
+        // section which ends the token: abc, "a b", ab"c d"
+        size_t start = i;
+        while(i < n && !isSpace(line[i]) && line[i] != '"') i++;
+        size_t prefixEnd = i;
+
+        if(i == n || line[i] != '"') {
+            args.push_back(line.substr(start, prefixEnd - start));
+            continue;
+        }
+
+        size_t quoteStart = ++i;
+        bool escaped = false;
+        while(i < n && line[i] != '"') {
+            if(line[i] == '\\' && i + 1 < n) {
+                escaped = true;
+                i += 2;
+            } else {
+                i++;
             }
-        } else {
-            token.push_back(ch);
         }
+        size_t quoteEnd = i;
+        bool closed = i < n;
+        if(closed) i++;
+
+        // common case: the whole token is one quoted slice
+        if(prefixEnd == start && !escaped) {
+            if(closed || quoteEnd > quoteStart) args.push_back(line.substr(quoteStart, quoteEnd - quoteStart));
+            continue;
+        }
+
+        // otherwise assemble it in scratch_; the output never exceeds the
+        // input, so reserving line.size() keeps earlier views valid
+        if(scratch_.empty() && scratch_.capacity() < n) scratch_.reserve(n);
+        size_t off = scratch_.size();
+        scratch_.append(line.data() + start, prefixEnd - start);
+        for(size_t j=quoteStart; j<quoteEnd; j++) {
+            if(line[j] == '\\' && j + 1 < quoteEnd) j++; // keep the escaped character
+            scratch_.push_back(line[j]);
+        }
+        if(closed || scratch_.size() > off) args.push_back(std::string_view(scratch_).substr(off));
     }
+}
 
-    if(!token.empty()) tokens.push_back(token);
-    return tokens;
+// strict base-10 integer: optional sign, digits only, must fit in int64_t
+static bool parseInt(std::string_view token, int64_t &out) {
+    if(!token.empty() && token[0] == '+') token.remove_prefix(1); // from_chars rejects '+'
+    if(token.empty()) return false;
+    auto [end, ec] = std::from_chars(token.data(), token.data() + token.size(), out);
+    return ec == std::errc() && end == token.data() + token.size();
 }
 
-Storage::Value CommandParser::parseValue(const std::string &token) {
-    // try int
-    try {
-        size_t pos;
-        int i = std::stoi(token, &pos);
-        if(pos == token.size()) return i;
-    } catch (...) {}
+// Numbers are recognised in a single pass with std::from_chars: no
+// exceptions, no locale, no temporary strings. Anything that isn't
+// [+-]digits[.digits][e[+-]digits] is kept as text (including inf/nan).
+Storage::Value CommandParser::parseValue(std::string_view token) {
+    bool numeric = !token.empty();
+    bool integral = true;
+    for(size_t i=0; i<token.size() && numeric; i++) {
+        char ch = token[i];
+        if(ch >= '0' && ch <= '9') continue;
+        if(ch == '+' || ch == '-') numeric = i == 0 || token[i - 1] == 'e' || token[i - 1] == 'E';
+        else if(ch == '.' || ch == 'e' || ch == 'E') integral = false;
+        else numeric = false;
+    }
 
-    // try double 
-    try {
-        size_t pos;
-        double d = std::stod(token, &pos);
-        if(pos == token.size()) return d;
-    } catch (...) {}
+    if(numeric) {
+        // try int
+        int64_t i;
+        if(integral && parseInt(token, i)) return i;
+
+        // try double (also covers integers too large for int64_t)
+        std::string_view digits = token[0] == '+' ? token.substr(1) : token;
+        double d;
+        auto [end, ec] = std::from_chars(digits.data(), digits.data() + digits.size(), d);
+        if(ec == std::errc() && end == digits.data() + digits.size()) return d;
+    }
 
     // try bool
     if(token == "true" || token == "TRUE") return true;
     if(token == "false" || token == "FALSE") return false;
 
     // fallback string
-    return token;
+    return std::string(token);
 }
 
 // helper to stringify variant value
 static std::string valueToString(const Storage::Value &v) {
     if(std::holds_alternative<std::string>(v)) return std::get<std::string>(v);
-    if(std::holds_alternative<int>(v)) return std::to_string(std::get<int>(v));
+    if(std::holds_alternative<int64_t>(v)) return std::string(IntegerText(std::get<int64_t>(v)).view());
     if(std::holds_alternative<double>(v)) return std::to_string(std::get<double>(v));
     if(std::holds_alternative<bool>(v)) return std::get<bool>(v) ? "true" : "false";
     return "(unknown)";
 }
 
-std::string CommandParser::execute(const std::string &line) {
-    // ensure base data directory exists
-    if(!std::filesystem::exists(DATA_DIR)) {
-        std::filesystem::create_directory(DATA_DIR);
+static std::string valueToString(const CompactValue &v) {
+    switch(v.type()) {
+        case CompactValue::Type::Int: return std::string(IntegerText(v.asInt()).view());
+        case CompactValue::Type::Double: return std::to_string(v.asDouble());
+        case CompactValue::Type::Bool: return v.asBool() ? "true" : "false";
+        default: return std::string(v.asString());
     }
+}
+
+std::string CommandParser::execute(std::string_view line) {
+    OutputBuffer out;
+    execute(line, out);
+    return out.str();
+}
+
+void CommandParser::execute(std::string_view line, OutputBuffer &out) {
+    ArgVector args;
+    tokenize(line, args);
+    if(args.empty()) return;
 
-    // ensure client-specific directory exists
-    std::string clientDir = DATA_DIR + "/client_" + std::to_string(clientSock);
-    if(!std::filesystem::exists(clientDir)) {
-        std::filesystem::create_directories(clientDir);
+    out.append(run(args, out));
+}
+
+/*
+ * Command table
+ * Built at compile time together with a perfect hash over the command
+ * names: buildIndex() searches for a seed under which every name lands in
+ * its own slot. Lookup is one case-insensitive hash, one index read and one
+ * case-insensitive compare, with no allocation and no table scan.
+ */
+
+namespace {
+
+constexpr char upper(char c) { return (c >= 'a' && c <= 'z') ? static_cast<char>(c - 'a' + 'A') : c; }
+
+constexpr size_t COMMAND_HASH_SLOTS = 256;
+
+// FNV-1a over the upper-cased name, mixed with a seed
+constexpr uint32_t commandHash(std::string_view name, uint32_t seed) {
+    uint32_t h = 2166136261u ^ seed;
+    for(char c: name) {
+        h ^= static_cast<uint8_t>(upper(c));
+        h *= 16777619u;
     }
+    return (h ^ (h >> 15)) % COMMAND_HASH_SLOTS;
+}
 
-    auto tokens = tokenize(line);
-    if(tokens.empty()) return "";
+bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+    if(a.size() != b.size()) return false;
+    for(size_t i=0; i<a.size(); i++) {
+        if(upper(a[i]) != upper(b[i])) return false;
+    }
+    return true;
+}
 
-    std::string cmd = tokens[0];
-    std::transform(cmd.begin(), cmd.end(), cmd.begin(), ::toupper);
+std::string wrongArity(std::string_view usage) {
+    return std::string(COLOR_RED) + "(error) wrong number of arguments, usage: " + std::string(usage) + COLOR_RESET;
+}
 
-    if(cmd == "SET") {
-        if(tokens.size() < 3) return std::string(COLOR_RED) + "(error) wrong number of arguments" + COLOR_RESET;
-        std::string key = tokens[1];
-        Storage::Value val = parseValue(tokens[2]);
-        if(tokens.size() == 4) {
-            int ttl = std::stoi(tokens[3]);
-            store.set(key, val, ttl);
-        } else {
-            store.set(key, val);
+// "(integer) n", with small n taken from the shared table
+std::string integerReply(int64_t n) {
+    std::string reply(COLOR_MAGENTA "(integer) ");
+    reply.append(IntegerText(n).view());
+    reply.append(COLOR_RESET);
+    return reply;
+}
+
+std::string notInteger() {
+    return std::string(COLOR_RED) + "(error) value is not an integer or out of range" + COLOR_RESET;
+}
+
+std::string overflowError() {
+    return std::string(COLOR_RED) + "(error) increment or decrement would overflow" + COLOR_RESET;
+}
+
+std::string syntaxError() {
+    return std::string(COLOR_RED) + "(error) syntax error" + COLOR_RESET;
+}
+
+// A stored value as a reply: large ones are queued by reference and sent
+// straight from the blob, integers (counters are the common case) skip
+// formatting for small values and never build a temporary string
+void appendValue(OutputBuffer &out, const CompactValue &val) {
+    out.append(COLOR_CYAN);
+    if(val.isBlob()) out.append(val.blob());
+    else if(val.type() == CompactValue::Type::Int) out.append(IntegerText(val.asInt()).view());
+    else out.append(valueToString(val));
+    out.append(COLOR_RESET);
+}
+
+// Reply for commands that return a key's old value, or (nil)
+std::string valueOrNil(const std::optional<CompactValue> &val, OutputBuffer &out) {
+    if(!val) return std::string(COLOR_YELLOW) + "(nil)" + COLOR_RESET;
+    appendValue(out, *val);
+    return "";
+}
+
+std::string outputLimitError() {
+    return std::string(COLOR_RED) + "(error) reply exceeds the client output limit" + COLOR_RESET;
+}
+
+std::string oomError() {
+    return std::string(COLOR_RED) + "(error) OOM command not allowed when used memory > 'maxmemory'" + COLOR_RESET;
+}
+
+} // namespace
+
+struct CommandTable {
+    using Spec = CommandParser::CommandSpec;
+
+    static constexpr Spec entries[] = {
+        {"SET",     -3, CommandParser::CMD_WRITE,    &CommandParser::cmdSet,
+         "SET <key> <value> [ttl] [NX | XX] [GET] [EX seconds | PX milliseconds | KEEPTTL]"},
+        {"GET",      2, CommandParser::CMD_READONLY, &CommandParser::cmdGet,     "GET <key>"},
+        {"DEL",      2, CommandParser::CMD_WRITE,    &CommandParser::cmdDel,     "DEL <key>"},
+        {"EXISTS",   2, CommandParser::CMD_READONLY, &CommandParser::cmdExists,  "EXISTS <key>"},
+        {"EXPIRE",   3, CommandParser::CMD_WRITE,    &CommandParser::cmdExpire,  "EXPIRE <key> <ttl>"},
+        {"PEXPIRE",  3, CommandParser::CMD_WRITE,    &CommandParser::cmdPExpire, "PEXPIRE <key> <milliseconds>"},
+        {"EXPIREAT", 3, CommandParser::CMD_WRITE,    &CommandParser::cmdExpireAt, "EXPIREAT <key> <unix-seconds>"},
+        {"PEXPIREAT", 3, CommandParser::CMD_WRITE,   &CommandParser::cmdPExpireAt, "PEXPIREAT <key> <unix-milliseconds>"},
+        {"TTL",      2, CommandParser::CMD_READONLY, &CommandParser::cmdTtl,     "TTL <key>"},
+        {"PTTL",     2, CommandParser::CMD_READONLY, &CommandParser::cmdPTtl,    "PTTL <key>"},
+        {"PERSIST",  2, CommandParser::CMD_WRITE,    &CommandParser::cmdPersist, "PERSIST <key>"},
+        {"GETSET",   3, CommandParser::CMD_WRITE,    &CommandParser::cmdGetSet,  "GETSET <key> <value>"},
+        {"GETDEL",   2, CommandParser::CMD_WRITE,    &CommandParser::cmdGetDel,  "GETDEL <key>"},
+        {"CAS",      4, CommandParser::CMD_WRITE,    &CommandParser::cmdCas,     "CAS <key> <expected> <value>"},
+        {"MGET",    -2, CommandParser::CMD_READONLY, &CommandParser::cmdMGet,    "MGET <key> [key ...]"},
+        {"MSET",    -3, CommandParser::CMD_WRITE,    &CommandParser::cmdMSet,    "MSET <key> <value> [key value ...]"},
+        {"MSETNX",  -3, CommandParser::CMD_WRITE,    &CommandParser::cmdMSetNx,  "MSETNX <key> <value> [key value ...]"},
+        {"INCR",     2, CommandParser::CMD_WRITE,    &CommandParser::cmdIncr,    "INCR <key>"},
+        {"DECR",     2, CommandParser::CMD_WRITE,    &CommandParser::cmdDecr,    "DECR <key>"},
+        {"INCRBY",   3, CommandParser::CMD_WRITE,    &CommandParser::cmdIncrBy,  "INCRBY <key> <increment>"},
+        {"DECRBY",   3, CommandParser::CMD_WRITE,    &CommandParser::cmdDecrBy,  "DECRBY <key> <decrement>"},
+        {"INCRBYFLOAT", 3, CommandParser::CMD_WRITE, &CommandParser::cmdIncrByFloat, "INCRBYFLOAT <key> <increment>"},
+        {"CINCR",    2, CommandParser::CMD_WRITE,    &CommandParser::cmdCIncr,   "CINCR <key>"},
+        {"CDECR",    2, CommandParser::CMD_WRITE,    &CommandParser::cmdCDecr,   "CDECR <key>"},
+        {"CINCRBY",  3, CommandParser::CMD_WRITE,    &CommandParser::cmdCIncrBy, "CINCRBY <key> <increment>"},
+        {"CDECRBY",  3, CommandParser::CMD_WRITE,    &CommandParser::cmdCDecrBy, "CDECRBY <key> <decrement>"},
+        {"SHOW",     1, CommandParser::CMD_READONLY, &CommandParser::cmdShow,    "SHOW"},
+        {"DISPLAY",  1, CommandParser::CMD_READONLY, &CommandParser::cmdShow,    "DISPLAY"},
+        {"SAVE",     2, CommandParser::CMD_ADMIN,    &CommandParser::cmdSave,    "SAVE <filename>"},
+        {"LOAD",     2, CommandParser::CMD_ADMIN | CommandParser::CMD_WRITE,
+                                                     &CommandParser::cmdLoad,    "LOAD <filename>"},
+        {"COMMAND", -1, CommandParser::CMD_READONLY, &CommandParser::cmdCommand, "COMMAND [COUNT | INFO [name ...]]"},
+        {"MEMORY",  -2, CommandParser::CMD_READONLY, &CommandParser::cmdMemory,  "MEMORY SLABS | STATS | USAGE <key>"},
+    };
+
+    static constexpr size_t size = sizeof(entries) / sizeof(entries[0]);
+
+    struct Index {
+        uint32_t seed;
+        int8_t slot[COMMAND_HASH_SLOTS];
+        bool found;
+    };
+
+    static constexpr Index buildIndex() {
+        Index idx{};
+        for(uint32_t seed=0; seed<1000; seed++) {
+            idx.seed = seed;
+            idx.found = true;
+            for(size_t i=0; i<COMMAND_HASH_SLOTS; i++) idx.slot[i] = -1;
+            for(size_t i=0; i<size && idx.found; i++) {
+                uint32_t h = commandHash(entries[i].name, seed);
+                if(idx.slot[h] != -1) idx.found = false;
+                idx.slot[h] = static_cast<int8_t>(i);
+            }
+            if(idx.found) break;
         }
-        return std::string(COLOR_GREEN) + "OK" + COLOR_RESET;
+        return idx;
     }
+};
 
-    if(cmd == "GET") {
-        if(tokens.size() != 2) return std::string(COLOR_RED) + "(error) wrong number of arguments" + COLOR_RESET;
-        std::string key = tokens[1];
+static constexpr CommandTable::Index COMMAND_INDEX = CommandTable::buildIndex();
+static_assert(COMMAND_INDEX.found, "no collision-free seed for the command table; grow COMMAND_HASH_SLOTS");
 
-        if(!store.exists(key)) {
-            return std::string(COLOR_YELLOW) + "(nil) no such key" + COLOR_RESET;
-        }
+const CommandParser::CommandSpec *CommandParser::lookupCommand(std::string_view name) {
+    if(name.empty()) return nullptr;
+    int8_t i = COMMAND_INDEX.slot[commandHash(name, COMMAND_INDEX.seed)];
+    if(i < 0 || !equalsIgnoreCase(CommandTable::entries[i].name, name)) return nullptr;
+    return &CommandTable::entries[i];
+}
 
-        auto val = store.get(key);
-        if(!val) return std::string(COLOR_YELLOW) + "(nil)" + COLOR_RESET;
-        return std::string(COLOR_CYAN) + valueToString(*val) + COLOR_RESET;
-    }
+std::string CommandParser::run(const ArgVector &args, OutputBuffer &out) {
+    const CommandSpec *spec = lookupCommand(args[0]);
+    if(!spec) return std::string(COLOR_RED) + "(error) unknown command" + COLOR_RESET;
 
-    if(cmd == "DEL") {
-        if(tokens.size() != 2) return std::string(COLOR_RED) + "(error) wrong number of arguments" + COLOR_RESET;
-        
-        std::string key = tokens[1];
-        if(!store.exists(key)) {
-            return std::string(COLOR_YELLOW) + "(nil) no such key" + COLOR_RESET;
-        }
-        
-        bool deleted = store.del(key);
-        return deleted 
-            ? std::string(COLOR_MAGENTA) + "(integer) 1" + COLOR_RESET
-            : std::string(COLOR_YELLOW) + "(nil) deletion failed" + COLOR_RESET;
-    }
-
-    if(cmd == "EXISTS") {
-        if(tokens.size() != 2) return std::string(COLOR_RED) + "(error) wrong number of arguments" + COLOR_RESET;
-        return store.exists(tokens[1]) 
-            ? std::string(COLOR_MAGENTA) + "(integer) 1" + COLOR_RESET
-            : std::string(COLOR_YELLOW) + "(integer) 0" + COLOR_RESET;
-    }
-
-    if(cmd == "EXPIRE") {
-        if(tokens.size() != 3) return std::string(COLOR_RED) + "(error) wrong number of arguments" + COLOR_RESET;
-        
-        std::string key = tokens[1];
-        if(!store.exists(key)) {
-            return std::string(COLOR_YELLOW) + "(nil) no such key to expire" + COLOR_RESET;
-        }
+    // arity counts the command name: N means exactly N args, -N at least N
+    int argc = static_cast<int>(args.size());
+    if(spec->arity >= 0 ? argc != spec->arity : argc < -spec->arity) return wrongArity(spec->usage);
 
-        try {
-            int ttl = std::stoi(tokens[2]);
-            if(ttl <= 0) return std::string(COLOR_RED) + "(error) TTL must be positive" + COLOR_RESET;
+    return (this->*spec->handler)(args, out);
+}
 
-            bool success = store.expire(key, ttl);
-            return success
-                ? std::string(COLOR_MAGENTA) + "(integer) 1" + COLOR_RESET
-                : std::string(COLOR_YELLOW) + "(nil) failed to set expiry" + COLOR_RESET;
-        } catch(...) {
+/*
+ * Command handlers
+ * Argument counts are already validated against the command table.
+ */
+
+// SET key value [ttl] [NX|XX] [GET] [EX s|PX ms|KEEPTTL]. The bare ttl
+// (seconds) is the original syntax and may only come right after the
+// value. The condition, the old value for GET and the write are all
+// handled by one Storage call, under one lock.
+std::string CommandParser::cmdSet(const ArgVector &args, OutputBuffer &out) {
+    std::string_view key = args[1];
+    Storage::Value val = parseValue(args[2]);
+
+    Storage::SetOptions options;
+    bool get = false, condition = false, expiry = false;
+    for(size_t i=3; i<args.size(); i++) {
+        std::string_view opt = args[i];
+        int64_t ttl;
+        if(i == 3 && parseInt(opt, ttl)) {
+            if(ttl > INT_MAX || ttl < INT_MIN) return std::string(COLOR_RED) + "(error) invalid TTL value" + COLOR_RESET;
+            options.ttl_ms = ttl * 1000;
+            expiry = true;
+        } else if((equalsIgnoreCase(opt, "NX") || equalsIgnoreCase(opt, "XX")) && !condition) {
+            options.condition = equalsIgnoreCase(opt, "NX") ? Storage::SetOptions::Condition::IfMissing
+                                                            : Storage::SetOptions::Condition::IfExists;
+            condition = true;
+        } else if(equalsIgnoreCase(opt, "GET") && !get) {
+            get = true;
+        } else if(equalsIgnoreCase(opt, "KEEPTTL") && !expiry) {
+            options.keep_ttl = true;
+            expiry = true;
+        } else if((equalsIgnoreCase(opt, "EX") || equalsIgnoreCase(opt, "PX")) && !expiry && i + 1 < args.size()) {
+            if(!parseInt(args[i + 1], ttl) || ttl <= 0 || (equalsIgnoreCase(opt, "EX") && ttl > INT64_MAX / 1000)) {
+                return std::string(COLOR_RED) + "(error) invalid expire time in 'set' command" + COLOR_RESET;
+            }
+            options.ttl_ms = equalsIgnoreCase(opt, "EX") ? ttl * 1000 : ttl;
+            expiry = true;
+            i++;
+        } else if(i == 3) {
             return std::string(COLOR_RED) + "(error) invalid TTL value" + COLOR_RESET;
+        } else {
+            return syntaxError();
         }
     }
 
-    if(cmd == "SHOW" || cmd == "DISPLAY") {
-        auto snapshot = store.dump();
-        if(snapshot.empty()) return std::string(COLOR_YELLOW) + "(empty) store" + COLOR_RESET;
+    std::optional<CompactValue> old;
+    auto status = store.set(key, val, options, get ? &old : nullptr);
+    if(status == Storage::SetStatus::OutOfMemory) return oomError();
+    if(get) return valueOrNil(old, out);
+    return status == Storage::SetStatus::Ok
+        ? std::string(COLOR_GREEN) + "OK" + COLOR_RESET
+        : std::string(COLOR_YELLOW) + "(nil)" + COLOR_RESET;
+}
+
+// GET, DEL and EXPIRE are one Storage call each: the lookup and the
+// operation happen together, so there is no window for the key to change
+// between them and no second probe
+std::string CommandParser::cmdGet(const ArgVector &args, OutputBuffer &out) {
+    auto val = store.getRef(args[1]);
+    if(!val) return std::string(COLOR_YELLOW) + "(nil) no such key" + COLOR_RESET;
+    appendValue(out, *val);
+    return "";
+}
+
+// GETSET key value == SET key value GET: replies with the old value
+std::string CommandParser::cmdGetSet(const ArgVector &args, OutputBuffer &out) {
+    std::optional<CompactValue> old;
+    if(store.set(args[1], parseValue(args[2]), Storage::SetOptions(), &old) == Storage::SetStatus::OutOfMemory) {
+        return oomError();
+    }
+    return valueOrNil(old, out);
+}
+
+std::string CommandParser::cmdGetDel(const ArgVector &args, OutputBuffer &out) {
+    return valueOrNil(store.getDel(args[1]), out);
+}
+
+// CAS key expected value -> 1 if the value was expected and got replaced,
+// 0 otherwise. expected is typed like any value: "5" matches the integer 5.
+std::string CommandParser::cmdCas(const ArgVector &args, OutputBuffer &) {
+    switch(store.compareAndSet(args[1], parseValue(args[2]), parseValue(args[3]))) {
+        case Storage::SetStatus::Ok:
+            return integerReply(1);
+        case Storage::SetStatus::ConditionFailed:
+            return std::string(COLOR_YELLOW) + "(integer) 0" + COLOR_RESET;
+        default:
+            return oomError();
+    }
+}
+
+std::string CommandParser::cmdDel(const ArgVector &args, OutputBuffer &) {
+    return store.del(args[1])
+        ? integerReply(1)
+        : std::string(COLOR_YELLOW) + "(nil) no such key" + COLOR_RESET;
+}
+
+std::string CommandParser::cmdExists(const ArgVector &args, OutputBuffer &) {
+    return store.exists(args[1]) 
+        ? integerReply(1)
+        : std::string(COLOR_YELLOW) + "(integer) 0" + COLOR_RESET;
+}
+
+std::string CommandParser::cmdExpire(const ArgVector &args, OutputBuffer &) {
+    int64_t ttl;
+    if(!parseInt(args[2], ttl) || ttl > INT_MAX) {
+        return std::string(COLOR_RED) + "(error) invalid TTL value" + COLOR_RESET;
+    }
+    if(ttl <= 0) return std::string(COLOR_RED) + "(error) TTL must be positive" + COLOR_RESET;
+
+    return store.expire(args[1], static_cast<int>(ttl))
+        ? integerReply(1)
+        : std::string(COLOR_YELLOW) + "(nil) no such key to expire" + COLOR_RESET;
+}
+
+// PEXPIRE key ms, EXPIREAT key unix-secs, PEXPIREAT key unix-ms: 1 if the
+// TTL was set, 0 if there is no such key. A deadline in the past (a TTL
+// of 0 or less, a negative timestamp) deletes the key, as in Redis.
+std::string CommandParser::pexpire(const ArgVector &args, int64_t unit_ms, bool absolute) {
+    int64_t n;
+    if(!parseInt(args[2], n) || n > INT64_MAX / unit_ms || n < INT64_MIN / unit_ms) {
+        return std::string(COLOR_RED) + "(error) invalid " + (absolute ? "timestamp" : "TTL value") + COLOR_RESET;
+    }
+
+    bool set = absolute ? store.pexpireAt(args[1], n * unit_ms) : store.pexpire(args[1], n * unit_ms);
+    return set ? integerReply(1) : std::string(COLOR_YELLOW) + "(integer) 0" + COLOR_RESET;
+}
+
+std::string CommandParser::cmdPExpire(const ArgVector &args, OutputBuffer &) {
+    return pexpire(args, 1, false);
+}
 
-        // Determine max key/value widths dynamically
-        size_t maxKeyLen = 3; // for header "KEY"
-        size_t maxValLen = 5; // for header "VALUE"
+std::string CommandParser::cmdExpireAt(const ArgVector &args, OutputBuffer &) {
+    return pexpire(args, 1000, true);
+}
 
-        for(const auto& [key, value]: snapshot) {
+std::string CommandParser::cmdPExpireAt(const ArgVector &args, OutputBuffer &) {
+    return pexpire(args, 1, true);
+}
+
+// TTL in seconds (rounded), PTTL in milliseconds; -1 without a TTL, -2
+// for a missing key
+std::string CommandParser::cmdTtl(const ArgVector &args, OutputBuffer &) {
+    int64_t ms = store.pttl(args[1]);
+    return integerReply(ms < 0 ? ms : (ms + 500) / 1000);
+}
+
+std::string CommandParser::cmdPTtl(const ArgVector &args, OutputBuffer &) {
+    return integerReply(store.pttl(args[1]));
+}
+
+std::string CommandParser::cmdPersist(const ArgVector &args, OutputBuffer &) {
+    return store.persist(args[1])
+        ? integerReply(1)
+        : std::string(COLOR_YELLOW) + "(integer) 0" + COLOR_RESET;
+}
+
+// MGET a b c -> one numbered line per key, (nil) for missing ones. All
+// keys are read in one batch; large values are sent from their blobs.
+std::string CommandParser::cmdMGet(const ArgVector &args, OutputBuffer &out) {
+    std::span<const std::string_view> keys(args.begin() + 1, args.end());
+    auto values = store.getMany(keys);
+
+    for(size_t i=0; i<values.size(); i++) {
+        if(i > 0) out.append("\n");
+        out.append(IntegerText(static_cast<int64_t>(i + 1)).view());
+        out.append(") ");
+        if(values[i]) appendValue(out, *values[i]);
+        else out.append(COLOR_YELLOW "(nil)" COLOR_RESET);
+        if(overOutputLimit(out)) return "\n" + outputLimitError();
+    }
+    return "";
+}
+
+// MSET k v [k v ...] sets every pair at once; MSETNX only if none of the
+// keys exists yet, replying 1 if it set them and 0 if it didn't
+std::string CommandParser::setMany(const ArgVector &args, bool only_if_none_exist) {
+    std::string_view usage = only_if_none_exist ? "MSETNX <key> <value> [key value ...]" : "MSET <key> <value> [key value ...]";
+    if(args.size() % 2 == 0) return wrongArity(usage);
+
+    std::vector<std::pair<std::string_view, Storage::Value>> pairs;
+    pairs.reserve(args.size() / 2);
+    for(size_t i=1; i<args.size(); i+=2) pairs.emplace_back(args[i], parseValue(args[i + 1]));
+
+    switch(store.setMany(pairs, only_if_none_exist)) {
+        case Storage::SetStatus::Ok:
+            return only_if_none_exist ? integerReply(1) : std::string(COLOR_GREEN) + "OK" + COLOR_RESET;
+        case Storage::SetStatus::ConditionFailed:
+            return std::string(COLOR_YELLOW) + "(integer) 0" + COLOR_RESET;
+        default:
+            return oomError();
+    }
+}
+
+std::string CommandParser::cmdMSet(const ArgVector &args, OutputBuffer &) {
+    return setMany(args, false);
+}
+
+std::string CommandParser::cmdMSetNx(const ArgVector &args, OutputBuffer &) {
+    return setMany(args, true);
+}
+
+// The increments run in one step inside Storage, so concurrent clients
+// never lose an update. A missing key starts from 0; the TTL is kept.
+std::string CommandParser::incrBy(std::string_view key, int64_t delta, bool striped) {
+    int64_t result;
+    auto status = striped ? store.incrCounter(key, delta, result) : store.incrBy(key, delta, result);
+    switch(status) {
+        case Storage::IncrStatus::Ok: return integerReply(result);
+        case Storage::IncrStatus::NotNumber: return notInteger();
+        case Storage::IncrStatus::Overflow: return overflowError();
+        default: return oomError();
+    }
+}
+
+std::string CommandParser::cmdIncr(const ArgVector &args, OutputBuffer &) {
+    return incrBy(args[1], 1);
+}
+
+std::string CommandParser::cmdDecr(const ArgVector &args, OutputBuffer &) {
+    return incrBy(args[1], -1);
+}
+
+std::string CommandParser::cmdIncrBy(const ArgVector &args, OutputBuffer &) {
+    int64_t delta;
+    if(!parseInt(args[2], delta)) return notInteger();
+    return incrBy(args[1], delta);
+}
+
+std::string CommandParser::cmdDecrBy(const ArgVector &args, OutputBuffer &) {
+    int64_t delta;
+    if(!parseInt(args[2], delta)) return notInteger();
+    if(delta == INT64_MIN) return overflowError(); // can't be negated
+    return incrBy(args[1], -delta);
+}
+
+// CINCR and friends behave like INCR, but keep the key as a striped
+// counter so that many clients bumping it at once don't contend
+std::string CommandParser::cmdCIncr(const ArgVector &args, OutputBuffer &) {
+    return incrBy(args[1], 1, true);
+}
+
+std::string CommandParser::cmdCDecr(const ArgVector &args, OutputBuffer &) {
+    return incrBy(args[1], -1, true);
+}
+
+std::string CommandParser::cmdCIncrBy(const ArgVector &args, OutputBuffer &) {
+    int64_t delta;
+    if(!parseInt(args[2], delta)) return notInteger();
+    return incrBy(args[1], delta, true);
+}
+
+std::string CommandParser::cmdCDecrBy(const ArgVector &args, OutputBuffer &) {
+    int64_t delta;
+    if(!parseInt(args[2], delta)) return notInteger();
+    if(delta == INT64_MIN) return overflowError();
+    return incrBy(args[1], -delta, true);
+}
+
+std::string CommandParser::cmdIncrByFloat(const ArgVector &args, OutputBuffer &) {
+    std::string_view token = args[2];
+    if(!token.empty() && token[0] == '+') token.remove_prefix(1);
+    double delta;
+    auto [end, ec] = std::from_chars(token.data(), token.data() + token.size(), delta);
+    if(token.empty() || ec != std::errc() || end != token.data() + token.size() || !std::isfinite(delta)) {
+        return std::string(COLOR_RED) + "(error) value is not a valid float" + COLOR_RESET;
+    }
+
+    double result;
+    switch(store.incrByFloat(args[1], delta, result)) {
+        case Storage::IncrStatus::Ok: return std::string(COLOR_CYAN) + valueToString(Storage::Value(result)) + COLOR_RESET;
+        case Storage::IncrStatus::NotNumber: return std::string(COLOR_RED) + "(error) value is not a valid float" + COLOR_RESET;
+        case Storage::IncrStatus::Overflow: return std::string(COLOR_RED) + "(error) increment would produce NaN or Infinity" + COLOR_RESET;
+        default: return oomError();
+    }
+}
+
+// The keyspace is read SHOW_BATCH slots at a time straight from the table,
+// once to size the columns and once to write the rows, so no copy of the
+// whole keyspace is built. Rows stop once the client's output limit is hit.
+std::string CommandParser::cmdShow(const ArgVector &, OutputBuffer &out) {
+    std::vector<std::pair<std::string, CompactValue>> batch;
+    batch.reserve(SHOW_BATCH);
+
+    // Determine max key/value widths dynamically
+    size_t maxKeyLen = 3; // for header "KEY"
+    size_t maxValLen = 5; // for header "VALUE"
+    bool empty = true;
+
+    size_t cursor = 0;
+    do {
+        cursor = store.scan(cursor, SHOW_BATCH, batch);
+        for(const auto& [key, value]: batch) {
             maxKeyLen = std::max(maxKeyLen, key.size());
+            maxValLen = std::max(maxValLen, valueToString(value).size());
+            empty = false;
+        }
+    } while(cursor != 0);
+    if(empty) return std::string(COLOR_YELLOW) + "(empty) store" + COLOR_RESET;
+
+    // Add some padding
+    maxKeyLen += 2;
+    maxValLen += 2;
+
+    // stream rows into the output buffer instead of building one big string
+    const std::string rule = std::string(maxKeyLen + maxValLen + 5, '-');
+    std::ostringstream header;
+    header << COLOR_CYAN << rule << "\n"
+           << std::left << std::setw(maxKeyLen) << "KEY"
+           << std::setw(maxValLen) << "VALUE" << "\n"
+           << rule << COLOR_RESET << "\n";
+    out.append(header.str());
+
+    std::string row;
+    do {
+        cursor = store.scan(cursor, SHOW_BATCH, batch);
+        for(const auto& [key, value]: batch) {
             std::string valStr = valueToString(value);
-            maxValLen = std::max(maxValLen, valStr.size());
+            row.assign(key);
+            row.append(maxKeyLen > key.size() ? maxKeyLen - key.size() : 0, ' ');
+            row.append(valStr);
+            row.append(maxValLen > valStr.size() ? maxValLen - valStr.size() : 0, ' ');
+            row.push_back('\n');
+            out.append(row);
         }
+        if(overOutputLimit(out)) return outputLimitError();
+    } while(cursor != 0);
 
-        // Add some padding
-        maxKeyLen += 2;
-        maxValLen += 2;
-
-        std::ostringstream out;
-        out << COLOR_CYAN 
-            << std::string(maxKeyLen + maxValLen + 5, '-') << "\n"
-            << std::left << std::setw(maxKeyLen) << "KEY" 
-            << std::setw(maxValLen) << "VALUE" << "\n"
-            << std::string(maxKeyLen + maxValLen + 5, '-') 
-            << COLOR_RESET << "\n";
-
-        for(const auto& [key, value]: snapshot) {
-            out << std::left << std::setw(maxKeyLen) << key
-                << std::setw(maxValLen) << valueToString(value) << "\n";
-        }
+    return std::string(COLOR_CYAN) + rule + COLOR_RESET;
+}
 
-        out << COLOR_CYAN << std::string(maxKeyLen + maxValLen + 5, '-') << COLOR_RESET;
-        return out.str();
+// SAVE (per-client isolation)
+std::string CommandParser::cmdSave(const ArgVector &args, OutputBuffer &) {
+    std::string filename = session.dataPath(args[1]);
+    if(!session.ensureDataDir()) return std::string(COLOR_RED) + "(error) could not create data directory" + COLOR_RESET;
+    return store.saveToFile(filename) 
+        ? std::string(COLOR_GREEN) + "OK: Saved to " + filename + COLOR_RESET
+        : std::string(COLOR_RED) + "(error) could not save file" + COLOR_RESET;
+}
+
+// LOAD
+std::string CommandParser::cmdLoad(const ArgVector &args, OutputBuffer &) {
+    std::string filename = session.dataPath(args[1]);
+    switch(store.loadFromFile(filename)) {
+        case Storage::LoadStatus::Ok:
+            return std::string(COLOR_GREEN) + "OK: Loaded from " + filename + COLOR_RESET;
+        case Storage::LoadStatus::OutOfMemory:
+            return std::string(COLOR_RED) + "(error) OOM: " + filename + " does not fit in 'maxmemory', nothing loaded" + COLOR_RESET;
+        default:
+            return std::string(COLOR_RED) + "(error) could not load file" + COLOR_RESET;
     }
+}
 
-    // SAVE (per-client isolation)
-    if(cmd == "SAVE") {
-        if(tokens.size() != 2) return std::string(COLOR_RED) + "(error) SAVE requires filename" + COLOR_RESET;
+// COMMAND            -> describe every command
+// COMMAND COUNT      -> number of commands
+// COMMAND INFO a b   -> describe the named commands
+std::string CommandParser::cmdCommand(const ArgVector &args, OutputBuffer &out) {
+    if(args.size() == 2 && equalsIgnoreCase(args[1], "COUNT")) {
+        return integerReply(static_cast<int64_t>(CommandTable::size));
+    }
 
-        std::string filename = clientDir + "/" + tokens[1];
-        return store.saveToFile(filename) 
-            ? std::string(COLOR_GREEN) + "OK: Saved to " + filename + COLOR_RESET
-            : std::string(COLOR_RED) + "(error) could not save file" + COLOR_RESET;
+    std::vector<const CommandSpec*> specs;
+    if(args.size() == 1) {
+        for(const auto &spec: CommandTable::entries) specs.push_back(&spec);
+    } else if(equalsIgnoreCase(args[1], "INFO")) {
+        for(size_t i=2; i<args.size(); i++) specs.push_back(lookupCommand(args[i]));
+    } else {
+        return std::string(COLOR_RED) + "(error) unknown COMMAND subcommand" + COLOR_RESET;
     }
 
-    // LOAD
-    if(cmd == "LOAD") {
-        if(tokens.size() != 2) return std::string(COLOR_RED) + "(error) LOAD requires filename" + COLOR_RESET;
+    std::ostringstream reply;
+    for(size_t i=0; i<specs.size(); i++) {
+        if(i > 0) reply << "\n";
+        reply << i + 1 << ") ";
+        if(!specs[i]) {
+            reply << COLOR_YELLOW << "(nil)" << COLOR_RESET;
+            continue;
+        }
+        std::string name(specs[i]->name);
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        reply << COLOR_CYAN << std::left << std::setw(13) << name << COLOR_RESET
+              << "arity " << std::setw(4) << specs[i]->arity
+              << "flags " << std::setw(16) << flagsToString(specs[i]->flags)
+              << specs[i]->usage;
+    }
+    if(specs.empty()) reply << COLOR_YELLOW << "(empty array)" << COLOR_RESET;
+
+    out.append(reply.str());
+    return "";
+}
+
+std::string CommandParser::flagsToString(uint32_t flags) {
+    std::string s;
+    if(flags & CMD_WRITE) s += "write,";
+    if(flags & CMD_READONLY) s += "readonly,";
+    if(flags & CMD_ADMIN) s += "admin,";
+    if(!s.empty()) s.pop_back();
+    return s;
+}
 
-        std::string filename = clientDir + "/" + tokens[1];
-        return store.loadFromFile(filename) 
-            ? std::string(COLOR_GREEN) + "OK: Loaded from " + filename + COLOR_RESET
-            : std::string(COLOR_RED) + "(error) could not load file" + COLOR_RESET;
+// MEMORY SLABS lists each entry size class; MEMORY STATS sums them up;
+// MEMORY USAGE <key> is the size of one entry
+std::string CommandParser::cmdMemory(const ArgVector &args, OutputBuffer &out) {
+    if(equalsIgnoreCase(args[1], "USAGE")) {
+        if(args.size() != 3) return wrongArity("MEMORY USAGE <key>");
+        auto bytes = store.memoryUsage(args[2]);
+        if(!bytes) return std::string(COLOR_YELLOW) + "(nil)" + COLOR_RESET;
+        return integerReply(static_cast<int64_t>(*bytes));
+    }
+    if(args.size() != 2) return wrongArity("MEMORY SLABS | STATS");
+
+    Storage::MemoryStats memory = store.memoryStats();
+    const SlabAllocator::Stats &stats = memory.slabs;
+    auto percent = [](size_t part, size_t whole) {
+        std::ostringstream p;
+        p << std::fixed << std::setprecision(1) << (whole ? 100.0 * part / whole : 0.0) << "%";
+        return p.str();
+    };
+
+    std::ostringstream reply;
+    if(equalsIgnoreCase(args[1], "SLABS")) {
+        for(size_t i=0; i<stats.classes.size(); i++) {
+            const auto &c = stats.classes[i];
+            if(i > 0) reply << "\n";
+            reply << i + 1 << ") " << COLOR_CYAN << "chunk " << std::left << std::setw(7) << c.chunk_size << COLOR_RESET
+                  << "slabs " << std::setw(6) << c.slabs
+                  << "used " << std::setw(10) << c.chunks_used
+                  << "free " << std::setw(10) << c.chunks_free
+                  << "util " << percent(c.chunks_used, c.chunks_used + c.chunks_free);
+            if(c.draining) reply << "  draining " << c.draining;
+        }
+        if(stats.classes.empty()) reply << COLOR_YELLOW << "(empty array)" << COLOR_RESET;
+    } else if(equalsIgnoreCase(args[1], "STATS")) {
+        const std::pair<const char *, std::string> rows[] = {
+            {"keys", std::to_string(store.size())},
+            {"slab_bytes", std::to_string(stats.slab_bytes)},
+            {"used_bytes", std::to_string(stats.used_bytes)},
+            {"utilization", percent(stats.used_bytes, stats.slab_bytes)},
+            {"large_allocs", std::to_string(stats.large_allocs)},
+            {"large_bytes", std::to_string(stats.large_bytes)},
+            {"defrag_running", memory.defrag_running ? "yes" : "no"},
+            {"defrag_cycles", std::to_string(memory.defrag_cycles)},
+            {"defrag_moved", std::to_string(memory.defrag_moved)},
+            {"used_memory", std::to_string(memory.used_memory)},
+            {"maxmemory", std::to_string(memory.maxmemory)},
+            {"maxmemory_policy", evictionPolicyName(memory.eviction_policy)},
+            {"evicted_keys", std::to_string(memory.evicted_keys)},
+        };
+        for(size_t i=0; i<std::size(rows); i++) {
+            if(i > 0) reply << "\n";
+            reply << i + 1 << ") " << COLOR_CYAN << std::left << std::setw(18) << rows[i].first << COLOR_RESET
+                  << rows[i].second;
+        }
+    } else {
+        return std::string(COLOR_RED) + "(error) unknown MEMORY subcommand" + COLOR_RESET;
     }
 
-    return std::string(COLOR_RED) + "(error) unknown command" + COLOR_RESET;
+    out.append(reply.str());
+    return "";
 }
@@ -0,0 +1,116 @@
+#include "epoch.h"
+#include <atomic>
+
+namespace epoch {
+namespace {
+
+constexpr uint64_t IDLE = 0;
+
+struct alignas(64) ReaderSlot {
+    std::atomic<uint64_t> epoch{IDLE}; // pinned epoch, IDLE outside a Guard
+    std::atomic<bool> taken{false};
+};
+
+// Blocks are chained and never freed: a reclaim may be walking them
+struct ReaderBlock {
+    ReaderSlot slots[READERS_PER_BLOCK];
+    std::atomic<size_t> used{0}; // slots below this have been handed out
+    std::atomic<ReaderBlock *> next{nullptr};
+};
+
+std::atomic<uint64_t> global_epoch{1};
+ReaderBlock first_block;
+
+// The calling thread's slot, taken on its first Guard and freed at exit
+struct ThreadState {
+    ReaderSlot *slot = nullptr;
+    unsigned depth = 0;
+    ~ThreadState() {
+        if(slot) slot->taken.store(false, std::memory_order_release);
+    }
+};
+thread_local ThreadState self;
+
+ReaderSlot *claimSlot() {
+    for(ReaderBlock *block = &first_block;;) {
+        for(size_t i=0; i<READERS_PER_BLOCK; i++) {
+            ReaderSlot &slot = block->slots[i];
+            bool expected = false;
+            if(slot.taken.load(std::memory_order_relaxed) ||
+               !slot.taken.compare_exchange_strong(expected, true, std::memory_order_acquire)) continue;
+
+            size_t used = block->used.load(std::memory_order_relaxed);
+            while(used <= i && !block->used.compare_exchange_weak(used, i + 1)) {}
+            return &slot;
+        }
+
+        // every slot here is busy: move on, adding a block if this is the last
+        ReaderBlock *next = block->next.load(std::memory_order_acquire);
+        if(!next) {
+            auto *fresh = new ReaderBlock;
+            if(block->next.compare_exchange_strong(next, fresh, std::memory_order_acq_rel)) next = fresh;
+            else delete fresh; // another thread added one first; next is it
+        }
+        block = next;
+    }
+}
+
+// Smallest epoch a reader has pinned, or UINT64_MAX with no reader inside
+uint64_t oldestPinned() {
+    // pairs with the fence in Guard(): either this scan sees the reader's
+    // slot, or the reader sees every unlink made before the scan
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint64_t oldest = UINT64_MAX;
+    for(const ReaderBlock *block = &first_block; block; block = block->next.load(std::memory_order_acquire)) {
+        size_t used = block->used.load(std::memory_order_acquire);
+        for(size_t i=0; i<used; i++) {
+            uint64_t pinned = block->slots[i].epoch.load(std::memory_order_acquire);
+            if(pinned != IDLE && pinned < oldest) oldest = pinned;
+        }
+    }
+    return oldest;
+}
+
+} // namespace
+
+Guard::Guard() {
+    if(self.depth++) return;
+    if(!self.slot) self.slot = claimSlot();
+    self.slot->epoch.store(global_epoch.load(std::memory_order_acquire), std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+Guard::~Guard() {
+    if(--self.depth) return;
+    self.slot->epoch.store(IDLE, std::memory_order_release);
+}
+
+RetireList::~RetireList() {
+    for(const Item &item: items_) item.deleter(item.context, item.object);
+}
+
+void RetireList::retire(void *object, Deleter deleter, void *context) {
+    // Orders the caller's unlink before the stamp: a reader that pinned a
+    // later epoch than the stamp is guaranteed to see the unlink
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    items_.push_back({global_epoch.load(std::memory_order_relaxed), object, deleter, context});
+}
+
+size_t RetireList::reclaim() {
+    if(items_.empty()) return 0;
+
+    // Readers that pin from now on see a later epoch than anything retired
+    // so far, and they also see the unlinks that preceded those retires
+    global_epoch.fetch_add(1, std::memory_order_acq_rel);
+    uint64_t oldest = oldestPinned();
+
+    size_t freed = 0;
+    while(freed < items_.size() && items_[freed].epoch < oldest) {
+        items_[freed].deleter(items_[freed].context, items_[freed].object);
+        freed++;
+    }
+    items_.erase(items_.begin(), items_.begin() + static_cast<std::ptrdiff_t>(freed));
+    return freed;
+}
+
+} // namespace epoch
@@ -3,15 +3,67 @@
 #include "../include/server.h"
 #include <iostream>
 #include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
-int main() {
+// "100mb", "2gb", "65536"; k/m/g suffixes are powers of 1024
+static size_t parseBytes(const std::string &text) {
+    size_t used = 0;
+    size_t bytes = std::stoull(text, &used);
+    std::string unit = text.substr(used);
+    std::transform(unit.begin(), unit.end(), unit.begin(), ::tolower);
+    if (unit == "k" || unit == "kb") return bytes << 10;
+    if (unit == "m" || unit == "mb") return bytes << 20;
+    if (unit == "g" || unit == "gb") return bytes << 30;
+    if (!unit.empty()) throw std::invalid_argument("bad size " + text);
+    return bytes;
+}
+
+int main(int argc, char **argv) {
     
     try {
-        Server server(6379);
+        ServerConfig config;
+        std::vector<std::string> shm_names;
+
+        // --shm <name> serves an extra same-host client over shared memory (repeatable)
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg == "--shm" && i + 1 < argc) {
+                shm_names.push_back(argv[++i]);
+            } else if (arg == "--idle-timeout" && i + 1 < argc) {
+                config.idle_timeout_secs = std::stoi(argv[++i]);
+            } else if (arg == "--read-timeout" && i + 1 < argc) {
+                config.read_timeout_secs = std::stoi(argv[++i]);
+            } else if (arg == "--maxmemory" && i + 1 < argc) {
+                config.storage.maxmemory = parseBytes(argv[++i]);
+            } else if (arg == "--maxmemory-policy" && i + 1 < argc && parseEvictionPolicy(argv[i + 1])) {
+                config.storage.eviction_policy = *parseEvictionPolicy(argv[++i]);
+            } else if (arg == "--no-active-defrag") {
+                config.storage.active_defrag = false;
+            } else if (arg == "--defrag-threshold" && i + 1 < argc) {
+                config.storage.defrag_threshold_pct = static_cast<unsigned>(std::stoul(argv[++i]));
+            } else if (arg == "--defrag-cpu" && i + 1 < argc) {
+                config.storage.defrag_cpu_pct = static_cast<unsigned>(std::stoul(argv[++i]));
+            } else if (arg == "--read-mode" && i + 1 < argc && parseReadMode(argv[i + 1])) {
+                config.storage.read_mode = *parseReadMode(argv[++i]);
+            } else {
+                std::cerr << "Usage: " << argv[0]
+                          << " [--shm <name>]... [--idle-timeout <secs>] [--read-timeout <secs>]"
+                          << " [--maxmemory <bytes>] [--maxmemory-policy noeviction|allkeys-lru|volatile-lru|allkeys-lfu|volatile-ttl]"
+                          << " [--no-active-defrag] [--defrag-threshold <pct>] [--defrag-cpu <pct>]"
+                          << " [--read-mode lockfree|shared|exclusive]\n";
+                return 1;
+            }
+        }
+
+        Server server(6379, config);
+        for (const auto &name : shm_names) server.add_shm_channel(name);
+
         server.start();
     } catch (const std::exception &e) {
         std::cerr << "Server error: " << e.what() << "\n";
     }
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,159 @@
+#include "output_buffer.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+constexpr int MAX_IOVECS = 64; // blocks handed to one sendmsg() call
+
+/*
+ * BlockPool
+ */
+
+BlockPool &BlockPool::instance() {
+    static BlockPool pool;
+    return pool;
+}
+
+BlockPool::~BlockPool() {
+    while(free_) {
+        Block *next = free_->next;
+        delete free_;
+        free_ = next;
+    }
+}
+
+BlockPool::Block *BlockPool::acquire() {
+    Block *block = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        if(free_) {
+            block = free_;
+            free_ = block->next;
+            cached_--;
+        }
+    }
+    if(!block) block = new Block;
+
+    block->next = nullptr;
+    block->blob = nullptr;
+    block->start = block->end = 0;
+    return block;
+}
+
+void BlockPool::release(Block *block) {
+    if(block->blob) {
+        block->blob->release();
+        block->blob = nullptr;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        if(cached_ < MAX_CACHED) {
+            block->next = free_;
+            free_ = block;
+            cached_++;
+            return;
+        }
+    }
+    delete block;
+}
+
+size_t BlockPool::cached() const {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return cached_;
+}
+
+/*
+ * OutputBuffer
+ */
+
+OutputBuffer::~OutputBuffer() {
+    clear();
+}
+
+void OutputBuffer::append(std::string_view data) {
+    while(!data.empty()) {
+        if(!tail_ || tail_->blob || tail_->end == sizeof(tail_->data)) {
+            BlockPool::Block *block = BlockPool::instance().acquire();
+            if(tail_) tail_->next = block;
+            else head_ = block;
+            tail_ = block;
+        }
+
+        size_t n = std::min(data.size(), sizeof(tail_->data) - tail_->end);
+        std::memcpy(tail_->data + tail_->end, data.data(), n);
+        tail_->end += n;
+        size_ += n;
+        data.remove_prefix(n);
+    }
+}
+
+void OutputBuffer::append(BlobRef blob) {
+    if(blob.size() < REFERENCE_MIN) {
+        append(blob.view());
+        return;
+    }
+
+    BlockPool::Block *block = BlockPool::instance().acquire();
+    block->end = blob.size();
+    block->blob = blob.release();
+    if(tail_) tail_->next = block;
+    else head_ = block;
+    tail_ = block;
+    size_ += block->end;
+}
+
+bool OutputBuffer::flush(int fd) {
+    while(size_ > 0) {
+        iovec iov[MAX_IOVECS];
+        int count = 0;
+        for(auto *b = head_; b && count < MAX_IOVECS; b = b->next) {
+            iov[count].iov_base = const_cast<char *>(b->bytes()) + b->start;
+            iov[count].iov_len = b->end - b->start;
+            count++;
+        }
+
+        msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+        ssize_t sent = sendmsg(fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if(sent < 0) {
+            if(errno == EINTR) continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK; // socket full, retry when writable
+        }
+
+        // release everything that went out
+        size_t remaining = static_cast<size_t>(sent);
+        size_ -= remaining;
+        while(remaining > 0) {
+            size_t chunk = std::min(remaining, head_->end - head_->start);
+            head_->start += chunk;
+            remaining -= chunk;
+            if(head_->start == head_->end) {
+                BlockPool::Block *next = head_->next;
+                BlockPool::instance().release(head_);
+                head_ = next;
+            }
+        }
+        if(!head_) tail_ = nullptr;
+    }
+    return true;
+}
+
+std::string OutputBuffer::str() const {
+    std::string out;
+    out.reserve(size_);
+    for(auto *b = head_; b; b = b->next) out.append(b->bytes() + b->start, b->end - b->start);
+    return out;
+}
+
+void OutputBuffer::clear() {
+    while(head_) {
+        BlockPool::Block *next = head_->next;
+        BlockPool::instance().release(head_);
+        head_ = next;
+    }
+    tail_ = nullptr;
+    size_ = 0;
+}
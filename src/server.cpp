@@ -1,16 +1,46 @@
 #include "server.h"
-#include "../include/constants.h"
 #include <iostream>
 #include <netinet/in.h>
+#include <sys/socket.h>
+#include <poll.h>
 #include <unistd.h>
+#include <cerrno>
+#include <chrono>
 #include <cstring>
+#include <cctype>
+#include <string_view>
 #include <algorithm>
-#include <filesystem>
+#include <memory>
 
 constexpr int BUFFER_SIZE = 1024;
+constexpr auto TIMER_TICK = std::chrono::milliseconds(100);
+constexpr size_t TIMER_SLOTS = 512;
 
-Server::Server(int port)
-    : port_(port), running_(false), server_sock_(-1) {}
+// EXIT / QUIT, case-insensitive
+static bool is_quit_command(std::string_view line) {
+    auto equals = [line](std::string_view word) {
+        return line.size() == word.size()
+            && std::equal(line.begin(), line.end(), word.begin(),
+                          [](char a, char b) { return std::toupper(static_cast<unsigned char>(a)) == b; });
+    };
+    return equals("EXIT") || equals("QUIT");
+}
+
+constexpr const char *AUTOSAVE_FILE = "autosave.json";
+
+// auto-save client db on disconnect to data/client_<id>/autosave.json
+static void autosave_client(const Storage &store, Session &session) {
+    std::string autosavePath = session.dataPath(AUTOSAVE_FILE);
+    if (!session.ensureDataDir() || !store.saveToFile(autosavePath)) {
+        std::cerr << "Warning: failed to autosave client data to " << autosavePath << "\n";
+    } else {
+        std::cout << "Autosaved client data to " << autosavePath << "\n";
+    }
+}
+
+Server::Server(int port, const ServerConfig &config)
+    : port_(port), server_sock_(-1), running_(false), config_(config),
+      timers_(TIMER_TICK, TIMER_SLOTS) {}
 
 Server::~Server() {
     stop();
@@ -41,6 +71,11 @@ void Server::start() {
     running_ = true;
     std::cout << "Server running on port " << port_ << "...\n";
 
+    for (const auto &name : shm_names_) {
+        client_threads_.emplace_back(&Server::handle_shm_client, this, name);
+        std::cout << "Serving shared memory channel '" << name << "'\n";
+    }
+
     accept_clients();
 
     for (auto &th : client_threads_) {
@@ -52,6 +87,16 @@ void Server::start() {
 
 void Server::accept_clients() {
     while (running_) {
+        // wake up every tick to drive connection timeouts even when nobody connects
+        pollfd pfd{server_sock_, POLLIN, 0};
+        int ready = poll(&pfd, 1, static_cast<int>(TIMER_TICK.count()));
+
+        timers_.advance(std::chrono::steady_clock::now());
+        reap_finished_clients();
+
+        if (!running_) break;
+        if (ready <= 0) continue;
+
         sockaddr_in client_addr{};
         socklen_t client_len = sizeof(client_addr);
         int client_sock = accept(server_sock_, (struct sockaddr*)&client_addr, &client_len);
@@ -68,22 +113,33 @@ void Server::accept_clients() {
     }
 }
 
+void Server::reap_finished_clients() {
+    std::vector<std::thread::id> finished;
+    {
+        std::lock_guard<std::mutex> lock(finished_mtx_);
+        finished.swap(finished_clients_);
+    }
+    if (finished.empty()) return;
+
+    for (auto it = client_threads_.begin(); it != client_threads_.end();) {
+        if (std::find(finished.begin(), finished.end(), it->get_id()) != finished.end()) {
+            it->join();
+            it = client_threads_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
 void Server::handle_client(int client_sock) {
     // create isolated store + parser for this client
-    Storage client_store;
-    CommandParser client_parser(client_store, client_sock);
-
-    // prepare client-specific directory: data/client_<sock>/
-    const std::string clientDir = DATA_DIR + "/client_" + std::to_string(client_sock);
-    std::error_code ec;
-    std::filesystem::create_directories(clientDir, ec);
-    if(ec) {
-        std::cerr << "Warning: could not create directory '" << clientDir << "': " << ec.message() << "\n";
-    }
+    Storage client_store(config_.storage);
+    Session session(client_sock);
+    session.setOutputLimit(config_.output_hard_limit);
+    CommandParser client_parser(client_store, session);
 
     // auto-load previous session data (autosave.json) if it exists
-    std::string autosavePath = clientDir + "/autosave.json";
-    client_store.loadFromFile(autosavePath); // loadFromFile returns false if file missing
+    client_store.loadFromFile(session.dataPath(AUTOSAVE_FILE)); // FileError if there is none yet
 
     const char* welcomeMsg =
         "\nWelcome to Mini Redis Server!\n"
@@ -99,64 +155,197 @@ void Server::handle_client(int client_sock) {
         "SAVE <filename>             -> Saves the data to a json file\n"
         "LOAD <filename>             -> loads the data from the json file\n"
         "--------------------------------------------\n\n";
-    send(client_sock, welcomeMsg, strlen(welcomeMsg), 0);
+    // replies queue up here and are flushed whenever the socket is writable
+    OutputBuffer out;
+    out.append(welcomeMsg);
 
-    std::string command;
-    char ch;
+    std::string input; // received bytes not yet executed
+    char buffer[BUFFER_SIZE];
+    bool soft_limited = false;
+    auto soft_since = std::chrono::steady_clock::now();
+
+    // a timed-out connection is shut down, which wakes this thread's poll()
+    std::atomic<bool> timed_out{false};
+    TimingWheel::Timer timer(timers_, [&timed_out, client_sock]() {
+        timed_out = true;
+        shutdown(client_sock, SHUT_RDWR);
+    });
+    bool reading_request = false; // part of a command line has arrived
+
+    auto arm_idle_timer = [&]() {
+        if (config_.idle_timeout_secs > 0) timers_.schedule(timer, std::chrono::seconds(config_.idle_timeout_secs));
+        else timers_.cancel(timer);
+    };
+    arm_idle_timer();
+
+    // Checked after every command, so one big reply in a pipelined batch
+    // cuts the client off before the next command runs. Whatever the
+    // socket takes right away doesn't count against the limit.
+    auto over_hard_limit = [&]() {
+        if (!config_.output_hard_limit || out.size() <= config_.output_hard_limit) return false;
+        return !out.flush(client_sock) || out.size() > config_.output_hard_limit;
+    };
 
     while (true) {
-        ssize_t n = recv(client_sock, &ch, 1, 0);
-        if (n <= 0) {
-            std::cout << "Client disconnected.\n";
+        // backpressure: stop reading new commands while the client isn't draining replies
+        bool over_soft = config_.output_soft_limit && out.size() >= config_.output_soft_limit;
+        pollfd pfd{client_sock, static_cast<short>(over_soft ? 0 : POLLIN), 0};
+        if (!out.empty()) pfd.events |= POLLOUT;
+
+        if (poll(&pfd, 1, over_soft ? 1000 : -1) < 0) {
+            if (errno == EINTR) continue;
             break;
         }
 
-        if (ch == '\n') {
-            if (!command.empty() && command.back() == '\r') command.pop_back();
-
-            std::string upperCmd = command;
-            std::transform(upperCmd.begin(), upperCmd.end(), upperCmd.begin(), ::toupper);
+        if (pfd.revents & POLLOUT) {
+            if (!out.flush(client_sock)) {
+                std::cout << "Client disconnected.\n";
+                break;
+            }
+            if (!reading_request) arm_idle_timer(); // draining replies counts as activity
+        }
 
-            if (upperCmd == "EXIT" || upperCmd == "QUIT") {
-                const char* goodbye = "Goodbye!\r\n";
-                send(client_sock, goodbye, strlen(goodbye), 0);
-                std::cout << "Client disconnected!\n";
+        if (pfd.revents & (POLLIN | POLLHUP | POLLERR)) {
+            ssize_t n = recv(client_sock, buffer, sizeof(buffer), MSG_DONTWAIT);
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) continue;
+            if (n <= 0) {
+                std::cout << "Client disconnected.\n";
                 break;
             }
 
-            if (!command.empty()) {
-                std::string response = client_parser.execute(command);
-                response += "\r\n";
-                ssize_t total_sent = 0;
-                while (total_sent < response.size()) {
-                    ssize_t sent = send(client_sock, response.c_str() + total_sent, response.size() - total_sent, 0);
-                    if (sent <= 0) break;
-                    total_sent += sent;
+            // commands are executed straight from the input buffer, no per-line copy
+            input.append(buffer, static_cast<size_t>(n));
+            size_t pos = 0, newline;
+            bool quit = false, over_hard = false;
+            while (!quit && !over_hard && (newline = input.find('\n', pos)) != std::string::npos) {
+                std::string_view line(input.data() + pos, newline - pos);
+                pos = newline + 1;
+                reading_request = false;
+                if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+
+                if (is_quit_command(line)) {
+                    out.append("Goodbye!\r\n");
+                    std::cout << "Client disconnected!\n";
+                    quit = true;
+                } else if (!line.empty()) {
+                    client_parser.execute(line, out);
+                    out.append("\r\n");
+                    over_hard = over_hard_limit();
                 }
             }
+            input.erase(0, pos);
+            if (over_hard) {
+                std::cerr << "Client exceeded output hard limit (" << out.size() << " bytes), disconnecting.\n";
+                break;
+            }
 
-            command.clear();
-        } else {
-            command.push_back(ch);
+            // reply right away; whatever doesn't fit waits for POLLOUT
+            if (!out.flush(client_sock) || quit) break;
+
+            // a partial command keeps the deadline set when it started
+            if (input.empty() || config_.read_timeout_secs <= 0) {
+                arm_idle_timer();
+            } else if (!reading_request) {
+                reading_request = true;
+                timers_.schedule(timer, std::chrono::seconds(config_.read_timeout_secs));
+            }
         }
-    }
 
-    // auto-save client db on disconnect to clientDir/autosave.json
-    if(!std::filesystem::exists(clientDir)) {
-        std::filesystem::create_directories(clientDir, ec);
+        // the soft limit keeps memory bounded when a client stops reading
+        if (config_.output_soft_limit && out.size() > config_.output_soft_limit) {
+            auto now = std::chrono::steady_clock::now();
+            if (!soft_limited) {
+                soft_limited = true;
+                soft_since = now;
+            } else if (now - soft_since > std::chrono::seconds(config_.output_soft_seconds)) {
+                std::cerr << "Client exceeded output soft limit for " << config_.output_soft_seconds
+                          << "s, disconnecting.\n";
+                break;
+            }
+        } else {
+            soft_limited = false;
+        }
     }
 
-    if (!client_store.saveToFile(autosavePath)) {
-        std::cerr << "Warning: failed to autosave client data to " << autosavePath << "\n";
-    } else {
-        std::cout << "Autosaved client data to " << autosavePath << "\n";
-    }
+    timers_.cancel(timer); // must not fire once the socket number can be reused
+    if (timed_out) std::cout << "Client timed out.\n";
 
+    autosave_client(client_store, session);
     close(client_sock);
+
+    std::lock_guard<std::mutex> lock(finished_mtx_);
+    finished_clients_.push_back(std::this_thread::get_id());
+}
+
+void Server::add_shm_channel(const std::string &name) {
+    shm_names_.push_back(name);
+}
+
+void Server::handle_shm_client(const std::string &name) {
+    // one client session per channel at a time; the segment is recreated after each
+    while (running_) {
+        std::unique_ptr<ShmChannel> channel;
+        try {
+            channel = std::make_unique<ShmChannel>(name, ShmChannel::Mode::Create);
+        } catch (const std::exception &e) {
+            std::cerr << "Shared memory channel error: " << e.what() << "\n";
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(shm_mtx_);
+            if (!running_) return;
+            shm_channels_.push_back(channel.get());
+        }
+
+        Storage client_store(config_.storage);
+        Session session(channel->fd(), name);
+        CommandParser client_parser(client_store, session);
+        client_store.loadFromFile(session.dataPath(AUTOSAVE_FILE));
+
+        // a client that exits without closing is noticed by the rings (they
+        // watch its pid); one that stays attached but silent is timed out
+        std::string request;
+        bool served = false;
+        while (true) {
+            auto status = ShmRing::ReadStatus::Ok;
+            if (config_.idle_timeout_secs > 0) {
+                status = channel->requests().readFor(request, std::chrono::seconds(config_.idle_timeout_secs));
+            } else if (!channel->requests().read(request)) {
+                status = ShmRing::ReadStatus::Closed;
+            }
+
+            if (status == ShmRing::ReadStatus::TimedOut) {
+                if (!channel->attached()) continue; // still waiting for a client
+                std::cout << "Shared memory client timed out.\n";
+                channel->close();
+                break;
+            }
+            if (status == ShmRing::ReadStatus::Closed) break;
+
+            served = true;
+            std::string response = client_parser.execute(request);
+            if (!channel->replies().write(response)) break;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(shm_mtx_);
+            shm_channels_.erase(std::remove(shm_channels_.begin(), shm_channels_.end(), channel.get()),
+                                shm_channels_.end());
+        }
+
+        if (served) {
+            std::cout << "Shared memory client disconnected.\n";
+            autosave_client(client_store, session);
+        }
+    }
 }
 
 void Server::stop() {
     if (!running_) return;
     running_ = false;
     if (server_sock_ >= 0) close(server_sock_);
+
+    std::lock_guard<std::mutex> lock(shm_mtx_);
+    for (auto *channel : shm_channels_) channel->close();
 }
@@ -0,0 +1,30 @@
+#include "session.h"
+#include "constants.h"
+#include <filesystem>
+#include <iostream>
+
+Session::Session(int id)
+    : id_(id), data_dir_(DATA_DIR + "/client_" + std::to_string(id)) {}
+
+Session::Session(int id, std::string_view shm_channel)
+    : id_(id), data_dir_(DATA_DIR + "/shm_" + std::string(shm_channel)) {}
+
+bool Session::ensureDataDir() {
+    if(dir_ready_) return true;
+
+    std::error_code ec;
+    std::filesystem::create_directories(data_dir_, ec);
+    if(ec) {
+        std::cerr << "Warning: could not create directory '" << data_dir_ << "': " << ec.message() << "\n";
+        return false;
+    }
+    dir_ready_ = true;
+    return true;
+}
+
+std::string Session::dataPath(std::string_view filename) const {
+    std::string path = data_dir_;
+    path += '/';
+    path += filename;
+    return path;
+}
@@ -0,0 +1,320 @@
+#include "shm_transport.h"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <utility>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr uint64_t CHANNEL_MAGIC = 0x324d4853444552ULL; // "REDSHM2"
+constexpr uint32_t FRAME_MORE = 0x80000000u;            // more frames follow
+constexpr uint32_t FRAME_PAD = 0xFFFFFFFFu;             // skip to start of ring
+constexpr int SPIN_LIMIT = 200;                          // busy polls before sleeping
+
+struct ShmChannelHeader {
+    std::atomic<uint64_t> magic;    // stored last, once the rings are ready
+    uint64_t capacity;
+    std::atomic<uint32_t> attached; // a client currently owns the channel
+    std::atomic<int32_t> server_pid;  // each side's rings watch the other's
+    std::atomic<int32_t> client_pid;
+};
+
+constexpr size_t align64(size_t n) { return (n + 63) & ~size_t(63); }
+
+// Frames are a 4-byte length word followed by the payload, padded to 8 bytes
+constexpr size_t frameSize(size_t len) { return (sizeof(uint32_t) + len + 7) & ~size_t(7); }
+
+size_t roundCapacity(size_t capacity) {
+    size_t cap = 4096;
+    while(cap < capacity) cap <<= 1;
+    return cap;
+}
+
+inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+// Futexes in a MAP_SHARED mapping must use the non-private operations.
+// Returns false if the wait timed out.
+bool futexWait(std::atomic<uint32_t> *word, uint32_t expected) {
+    timespec timeout{0, 100 * 1000 * 1000}; // re-check closed flag and peer periodically
+    return syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAIT, expected, &timeout, nullptr, 0) == 0
+        || errno != ETIMEDOUT;
+}
+
+void futexWake(std::atomic<uint32_t> *word) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+} // namespace
+
+/*
+ * ShmRing
+ */
+
+ShmRing::ShmRing(ShmRingHeader *hdr, char *data, size_t capacity, const std::atomic<int32_t> *peer_pid)
+    : hdr_(hdr), data_(data), capacity_(capacity), peer_pid_(peer_pid) {}
+
+// A peer that died can't close the ring itself, so a waiter that slept a
+// full futex timeout checks the process is still there and closes for it
+bool ShmRing::peerGone() {
+    pid_t pid = peer_pid_ ? peer_pid_->load(std::memory_order_acquire) : 0;
+    if(pid == 0 || kill(pid, 0) == 0 || errno != ESRCH) return false;
+    close();
+    return true;
+}
+
+bool ShmRing::waitForSpace(uint64_t head, size_t need) {
+    for(int spin = 0;; spin++) {
+        if(hdr_->closed.load(std::memory_order_acquire)) return false;
+        if(capacity_ - (head - hdr_->tail.load(std::memory_order_acquire)) >= need) return true;
+        if(spin < SPIN_LIMIT) {
+            cpuRelax();
+            continue;
+        }
+
+        // announce ourselves, then re-check before sleeping so a concurrent
+        // consume either changes the futex word or is seen here
+        uint32_t seq = hdr_->space_seq.load(std::memory_order_acquire);
+        bool woken = true;
+        hdr_->space_waiters.fetch_add(1);
+        if(capacity_ - (head - hdr_->tail.load()) < need && !hdr_->closed.load()) {
+            woken = futexWait(&hdr_->space_seq, seq);
+        }
+        hdr_->space_waiters.fetch_sub(1);
+        if(!woken && peerGone()) return false;
+    }
+}
+
+ShmRing::ReadStatus ShmRing::waitForData(uint64_t tail, Clock::time_point deadline) {
+    for(int spin = 0;; spin++) {
+        if(hdr_->head.load(std::memory_order_acquire) != tail) return ReadStatus::Ok;
+        if(hdr_->closed.load(std::memory_order_acquire)) return ReadStatus::Closed;
+        if(spin < SPIN_LIMIT) {
+            cpuRelax();
+            continue;
+        }
+        if(Clock::now() >= deadline) return ReadStatus::TimedOut;
+
+        uint32_t seq = hdr_->data_seq.load(std::memory_order_acquire);
+        bool woken = true;
+        hdr_->data_waiters.fetch_add(1);
+        if(hdr_->head.load() == tail && !hdr_->closed.load()) {
+            woken = futexWait(&hdr_->data_seq, seq);
+        }
+        hdr_->data_waiters.fetch_sub(1);
+        if(!woken && peerGone()) return ReadStatus::Closed;
+    }
+}
+
+bool ShmRing::write(std::string_view msg) {
+    const size_t maxChunk = capacity_ / 2 - sizeof(uint32_t);
+    size_t off = 0;
+
+    do {
+        size_t len = std::min(msg.size() - off, maxChunk);
+        bool more = off + len < msg.size();
+        size_t need = frameSize(len);
+
+        uint64_t head = hdr_->head.load(std::memory_order_relaxed);
+        size_t pos = head & (capacity_ - 1);
+        size_t contiguous = capacity_ - pos;
+
+        // frames never wrap, so the consumer can always read them in place
+        size_t pad = need > contiguous ? contiguous : 0;
+        if(!waitForSpace(head, pad + need)) return false;
+
+        if(pad) {
+            std::memcpy(data_ + pos, &FRAME_PAD, sizeof(FRAME_PAD));
+            head += pad;
+            pos = 0;
+        }
+
+        uint32_t word = static_cast<uint32_t>(len) | (more ? FRAME_MORE : 0);
+        std::memcpy(data_ + pos, &word, sizeof(word));
+        std::memcpy(data_ + pos + sizeof(word), msg.data() + off, len);
+        hdr_->head.store(head + need, std::memory_order_release);
+
+        hdr_->data_seq.fetch_add(1);
+        if(hdr_->data_waiters.load()) futexWake(&hdr_->data_seq);
+
+        off += len;
+    } while(off < msg.size());
+
+    return true;
+}
+
+bool ShmRing::read(std::string &out) {
+    return readUntil(out, Clock::time_point::max()) == ReadStatus::Ok;
+}
+
+ShmRing::ReadStatus ShmRing::readFor(std::string &out, std::chrono::milliseconds timeout) {
+    return readUntil(out, Clock::now() + timeout);
+}
+
+ShmRing::ReadStatus ShmRing::readUntil(std::string &out, Clock::time_point deadline) {
+    if(!partial_) out.clear();
+    uint64_t tail = hdr_->tail.load(std::memory_order_relaxed);
+
+    while(true) {
+        ReadStatus status = waitForData(tail, deadline);
+        if(status != ReadStatus::Ok) return status;
+
+        size_t pos = tail & (capacity_ - 1);
+        uint32_t word;
+        std::memcpy(&word, data_ + pos, sizeof(word));
+
+        if(word == FRAME_PAD) {
+            tail += capacity_ - pos;
+        } else {
+            size_t len = word & ~FRAME_MORE;
+            out.append(data_ + pos + sizeof(word), len);
+            tail += frameSize(len);
+        }
+        hdr_->tail.store(tail, std::memory_order_release);
+
+        hdr_->space_seq.fetch_add(1);
+        if(hdr_->space_waiters.load()) futexWake(&hdr_->space_seq);
+
+        if(word != FRAME_PAD) partial_ = word & FRAME_MORE;
+        if(word != FRAME_PAD && !partial_) return ReadStatus::Ok;
+    }
+}
+
+void ShmRing::close() {
+    if(!hdr_) return;
+    hdr_->closed.store(1, std::memory_order_release);
+    hdr_->data_seq.fetch_add(1);
+    hdr_->space_seq.fetch_add(1);
+    futexWake(&hdr_->data_seq);
+    futexWake(&hdr_->space_seq);
+}
+
+bool ShmRing::closed() const {
+    return hdr_ && hdr_->closed.load(std::memory_order_acquire);
+}
+
+/*
+ * ShmChannel
+ * layout: [channel header][request ring header][request data][reply ring header][reply data]
+ */
+
+ShmChannel::ShmChannel(const std::string &name, Mode mode, size_t capacity)
+    : path_("/mini_redis." + name), mode_(mode), fd_(-1), base_(nullptr), mapped_size_(0) {
+    const size_t ringHeaderSize = align64(sizeof(ShmRingHeader));
+    const size_t channelHeaderSize = align64(sizeof(ShmChannelHeader));
+
+    if(mode_ == Mode::Create) {
+        capacity = roundCapacity(capacity);
+        mapped_size_ = channelHeaderSize + 2 * (ringHeaderSize + capacity);
+
+        shm_unlink(path_.c_str()); // drop a stale segment left by a crashed server
+        fd_ = shm_open(path_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if(fd_ < 0) throw std::runtime_error("shm_open failed for " + path_);
+
+        if(ftruncate(fd_, static_cast<off_t>(mapped_size_)) < 0) {
+            ::close(fd_);
+            shm_unlink(path_.c_str());
+            throw std::runtime_error("Could not size shared memory segment " + path_);
+        }
+    } else {
+        fd_ = shm_open(path_.c_str(), O_RDWR, 0600);
+        if(fd_ < 0) throw std::runtime_error("No shared memory channel " + path_);
+
+        struct stat st{};
+        if(fstat(fd_, &st) < 0 || static_cast<size_t>(st.st_size) < channelHeaderSize) {
+            ::close(fd_);
+            throw std::runtime_error("Invalid shared memory channel " + path_);
+        }
+        mapped_size_ = static_cast<size_t>(st.st_size);
+    }
+
+    base_ = mmap(nullptr, mapped_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if(base_ == MAP_FAILED) {
+        ::close(fd_);
+        if(mode_ == Mode::Create) shm_unlink(path_.c_str());
+        throw std::runtime_error("mmap failed for " + path_);
+    }
+
+    char *base = static_cast<char *>(base_);
+    auto *hdr = reinterpret_cast<ShmChannelHeader *>(base);
+    auto ringHeaders = [&]() {
+        char *reqHeader = base + channelHeaderSize;
+        return std::make_pair(reqHeader, reqHeader + ringHeaderSize + capacity);
+    };
+
+    if(mode_ == Mode::Create) {
+        // a client that attaches early sees no magic until both rings are
+        // built, so it never reads a half-initialised header
+        new (hdr) ShmChannelHeader{{0}, capacity, {0}, {getpid()}, {0}};
+        auto [reqHeader, repHeader] = ringHeaders();
+        new (reqHeader) ShmRingHeader{};
+        new (repHeader) ShmRingHeader{};
+        hdr->magic.store(CHANNEL_MAGIC, std::memory_order_release);
+    } else {
+        uint32_t expected = 0;
+        if(hdr->magic.load(std::memory_order_acquire) != CHANNEL_MAGIC
+           || mapped_size_ != channelHeaderSize + 2 * (ringHeaderSize + hdr->capacity)) {
+            munmap(base_, mapped_size_);
+            ::close(fd_);
+            throw std::runtime_error("Invalid shared memory channel " + path_);
+        }
+        if(!hdr->attached.compare_exchange_strong(expected, 1)) {
+            munmap(base_, mapped_size_);
+            ::close(fd_);
+            throw std::runtime_error("Shared memory channel " + path_ + " is busy");
+        }
+        hdr->client_pid.store(getpid(), std::memory_order_release);
+        capacity = hdr->capacity;
+    }
+
+    auto [reqHeader, repHeader] = ringHeaders();
+    const auto *peer = mode_ == Mode::Create ? &hdr->client_pid : &hdr->server_pid;
+    requests_ = ShmRing(reinterpret_cast<ShmRingHeader *>(reqHeader), reqHeader + ringHeaderSize, capacity, peer);
+    replies_ = ShmRing(reinterpret_cast<ShmRingHeader *>(repHeader), repHeader + ringHeaderSize, capacity, peer);
+}
+
+ShmChannel::~ShmChannel() {
+    if(mode_ == Mode::Open) close();
+    munmap(base_, mapped_size_);
+    ::close(fd_);
+    if(mode_ == Mode::Create) shm_unlink(path_.c_str());
+}
+
+void ShmChannel::close() {
+    requests_.close();
+    replies_.close();
+}
+
+bool ShmChannel::attached() const {
+    return static_cast<const ShmChannelHeader *>(base_)->attached.load(std::memory_order_acquire);
+}
+
+/*
+ * ShmClient
+ */
+
+ShmClient::ShmClient(const std::string &name) : channel_(name, ShmChannel::Mode::Open) {}
+
+ShmClient::~ShmClient() {
+    channel_.close();
+}
+
+const std::string &ShmClient::execute(std::string_view command) {
+    if(!channel_.requests().write(command) || !channel_.replies().read(reply_)) {
+        throw std::runtime_error("Shared memory channel closed by server");
+    }
+    return reply_;
+}
@@ -0,0 +1,228 @@
+#include "slab_allocator.h"
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+// Header at the start of every slab; chunks follow at SLAB_HEADER
+struct SlabAllocator::Slab {
+    Slab *prev;         // in SizeClass::slabs
+    Slab *next;
+    Slab *partial_prev; // in SizeClass::partial
+    Slab *partial_next;
+    void *free;         // recycled chunks, linked through their first word
+    char *bump;         // next chunk never handed out
+    uint32_t used;
+    uint32_t capacity;
+    uint32_t cls;
+    bool in_partial;
+    bool draining;      // being emptied by defrag: no new allocations
+};
+
+namespace {
+
+constexpr size_t SLAB_HEADER = 64; // keeps chunks 16-byte aligned
+
+template <typename T>
+void pushFront(T *&head, T *node, T *T::*prev, T *T::*next) {
+    node->*prev = nullptr;
+    node->*next = head;
+    if(head) head->*prev = node;
+    head = node;
+}
+
+template <typename T>
+void unlink(T *&head, T *node, T *T::*prev, T *T::*next) {
+    if(node->*prev) (node->*prev)->*next = node->*next;
+    else head = node->*next;
+    if(node->*next) (node->*next)->*prev = node->*prev;
+}
+
+} // namespace
+
+SlabAllocator::SlabAllocator() : class_of_(MAX_CHUNK / 16 + 1) {
+    static_assert(sizeof(Slab) <= SLAB_HEADER, "slab header too large");
+
+    for(size_t size = 16; size <= MAX_CHUNK; size = sizeClass(size + 1)) {
+        SizeClass c;
+        c.chunk_size = size;
+        classes_.push_back(c);
+    }
+    size_t cls = 0;
+    for(size_t i=0; i<class_of_.size(); i++) {
+        while(classes_[cls].chunk_size < i * 16) cls++;
+        class_of_[i] = static_cast<uint8_t>(cls);
+    }
+}
+
+SlabAllocator::~SlabAllocator() {
+    for(auto &c: classes_) {
+        while(c.slabs) {
+            Slab *slab = c.slabs;
+            c.slabs = slab->next;
+            std::free(slab);
+        }
+    }
+}
+
+SlabAllocator::Slab *SlabAllocator::newSlab(size_t cls) {
+    SizeClass &c = classes_[cls];
+    Slab *slab = c.spare;
+    if(slab) {
+        c.spare = nullptr;
+    } else {
+        slab = static_cast<Slab *>(std::aligned_alloc(SLAB_SIZE, SLAB_SIZE));
+        if(!slab) throw std::bad_alloc();
+        slab->capacity = static_cast<uint32_t>((SLAB_SIZE - SLAB_HEADER) / c.chunk_size);
+        slab->cls = static_cast<uint32_t>(cls);
+        pushFront(c.slabs, slab, &Slab::prev, &Slab::next);
+        c.slab_count++;
+        c.capacity += slab->capacity;
+        slab_bytes_ += SLAB_SIZE;
+    }
+    slab->free = nullptr;
+    slab->bump = reinterpret_cast<char *>(slab) + SLAB_HEADER;
+    slab->used = 0;
+    slab->draining = false;
+    pushFront(c.partial, slab, &Slab::partial_prev, &Slab::partial_next);
+    slab->in_partial = true;
+    return slab;
+}
+
+void SlabAllocator::releaseSlab(Slab *slab) {
+    SizeClass &c = classes_[slab->cls];
+    if(slab->in_partial) {
+        unlink(c.partial, slab, &Slab::partial_prev, &Slab::partial_next);
+        slab->in_partial = false;
+    }
+    slab->draining = false;
+    if(!c.spare) {
+        c.spare = slab;
+        return;
+    }
+    unlink(c.slabs, slab, &Slab::prev, &Slab::next);
+    c.slab_count--;
+    c.capacity -= slab->capacity;
+    slab_bytes_ -= SLAB_SIZE;
+    std::free(slab);
+}
+
+void *SlabAllocator::allocate(size_t size) {
+    if(size > MAX_CHUNK) {
+        large_allocs_++;
+        large_bytes_ += size;
+        allocated_bytes_ += size;
+        return ::operator new(size);
+    }
+
+    size_t cls = class_of_[(size + 15) / 16];
+    SizeClass &c = classes_[cls];
+    Slab *slab = c.partial ? c.partial : newSlab(cls);
+
+    void *p;
+    if(slab->free) {
+        p = slab->free;
+        slab->free = *static_cast<void **>(p);
+    } else {
+        p = slab->bump;
+        slab->bump += c.chunk_size;
+    }
+    slab->used++;
+    c.used++;
+    allocated_bytes_ += c.chunk_size;
+
+    // full slabs leave the partial list until a chunk comes back
+    if(slab->used == slab->capacity) {
+        unlink(c.partial, slab, &Slab::partial_prev, &Slab::partial_next);
+        slab->in_partial = false;
+    }
+    return p;
+}
+
+void SlabAllocator::deallocate(void *p, size_t size) {
+    if(size > MAX_CHUNK) {
+        large_allocs_--;
+        large_bytes_ -= size;
+        allocated_bytes_ -= size;
+        ::operator delete(p);
+        return;
+    }
+
+    auto *slab = reinterpret_cast<Slab *>(reinterpret_cast<uintptr_t>(p) & ~uintptr_t(SLAB_SIZE - 1));
+    SizeClass &c = classes_[slab->cls];
+
+    *static_cast<void **>(p) = slab->free;
+    slab->free = p;
+    slab->used--;
+    c.used--;
+    allocated_bytes_ -= c.chunk_size;
+
+    if(slab->used == 0) {
+        releaseSlab(slab);
+    } else if(!slab->in_partial && !slab->draining) {
+        pushFront(c.partial, slab, &Slab::partial_prev, &Slab::partial_next);
+        slab->in_partial = true;
+    }
+}
+
+SlabAllocator::Stats SlabAllocator::stats() const {
+    Stats s;
+    for(const auto &c: classes_) {
+        if(!c.slab_count) continue;
+        size_t draining = 0;
+        for(const Slab *slab = c.slabs; slab; slab = slab->next) draining += slab->draining;
+        s.classes.push_back({c.chunk_size, c.slab_count, c.used, c.capacity - c.used, draining});
+        s.slab_bytes += c.slab_count * SLAB_SIZE;
+        s.used_bytes += c.used * c.chunk_size;
+    }
+    s.large_allocs = large_allocs_;
+    s.large_bytes = large_bytes_;
+    return s;
+}
+
+size_t SlabAllocator::beginDrain(unsigned fill_pct) {
+    size_t marked = 0;
+    for(auto &c: classes_) {
+        if(c.slab_count < 2) continue;
+        const size_t perSlab = (SLAB_SIZE - SLAB_HEADER) / c.chunk_size;
+        // free chunks outside the spare, in whole slabs: what draining can win back
+        size_t spareChunks = c.spare ? c.spare->capacity : 0;
+        size_t freeable = (c.capacity - c.used - spareChunks) / perSlab;
+        if(!freeable) continue;
+
+        std::vector<Slab *> sparse;
+        for(Slab *slab = c.slabs; slab; slab = slab->next) {
+            if(slab != c.spare && slab->used * 100 < slab->capacity * fill_pct) sparse.push_back(slab);
+        }
+        std::sort(sparse.begin(), sparse.end(), [](const Slab *a, const Slab *b) { return a->used < b->used; });
+        if(sparse.size() > freeable) sparse.resize(freeable);
+
+        for(Slab *slab: sparse) {
+            slab->draining = true;
+            if(slab->in_partial) {
+                unlink(c.partial, slab, &Slab::partial_prev, &Slab::partial_next);
+                slab->in_partial = false;
+            }
+            marked++;
+        }
+    }
+    return marked;
+}
+
+bool SlabAllocator::draining(const void *p, size_t size) const {
+    if(size > MAX_CHUNK) return false;
+    auto *slab = reinterpret_cast<const Slab *>(reinterpret_cast<uintptr_t>(p) & ~uintptr_t(SLAB_SIZE - 1));
+    return slab->draining;
+}
+
+void SlabAllocator::endDrain() {
+    for(auto &c: classes_) {
+        for(Slab *slab = c.slabs; slab; slab = slab->next) {
+            if(!slab->draining) continue;
+            slab->draining = false;
+            if(slab->used < slab->capacity && !slab->in_partial) {
+                pushFront(c.partial, slab, &Slab::partial_prev, &Slab::partial_next);
+                slab->in_partial = true;
+            }
+        }
+    }
+}
@@ -1,10 +1,182 @@
 #include "storage.h"
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <fstream>  // std::ofstream, std::ifstream
 
-// Thread safety: Every method locks mtx_ to ensure safe access
+// Thread safety: writers lock mtx_ exclusively, read-only walks share it,
+// and get()/exists() follow options_.read_mode
 
-Storage::Storage()
+namespace
+{
+    constexpr std::chrono::milliseconds CLEANER_TICK(100);
+    constexpr size_t EXPIRE_SLOTS_PER_STEP = 1024;             // expiry walk per step
+    constexpr std::chrono::microseconds EXPIRE_BUDGET(1000);   // most expiry work per tick
+    constexpr std::chrono::microseconds REHASH_BUDGET(1000);   // idle rehash work per tick
+    constexpr size_t REHASH_GROUPS_PER_STEP = 64;
+    constexpr size_t DEFRAG_SLOTS_PER_STEP = 64;               // clock checked between steps
+    constexpr size_t EVICTION_POOL_SIZE = 16;
+    constexpr size_t EVICTION_SLOTS_PER_SAMPLE = 64;           // walk limit per wanted sample
+    constexpr uint32_t LFU_INIT_VAL = 5;                       // new keys get a chance to be used
+    constexpr size_t RECLAIM_BATCH = 256;                      // retired entries before a reclaim pass
+    constexpr size_t INDEX_SLOT_BYTES = sizeof(void *) + 1;    // slot pointer plus control byte
+    constexpr size_t BLOB_MIN_SIZE = 512;                      // strings this long go in a shared blob
+    constexpr size_t SLAB_BLOB_MAX = SlabAllocator::MAX_CHUNK - sizeof(Blob); // longer ones: heap blobs
+
+    // Steady-clock milliseconds, the unit of packed expiries (never 0)
+    uint64_t nowMs()
+    {
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        return ms > 0 ? static_cast<uint64_t>(ms) : 1;
+    }
+
+    // Deadline ttl_ms from now; a non-positive TTL is already in the past.
+    // TTLs past what an entry can hold are clamped to its furthest expiry.
+    uint64_t expiryAfterMs(int64_t ttl_ms)
+    {
+        int64_t now = static_cast<int64_t>(nowMs());
+        if (ttl_ms >= static_cast<int64_t>(Entry::EXPIRY_MASK) - now)
+            return Entry::EXPIRY_MASK;
+        int64_t ms = now + ttl_ms;
+        return ms > 0 ? static_cast<uint64_t>(ms) : 1;
+    }
+
+    uint64_t expiryAfter(int64_t ttl_secs)
+    {
+        return expiryAfterMs(ttl_secs * 1000);
+    }
+
+    // Expiries are kept on the steady clock; a Unix time is turned into a
+    // TTL against the wall clock once, when it is set
+    uint64_t expiryAtUnixMs(int64_t unix_ms)
+    {
+        int64_t wall = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        if (unix_ms < 0)
+            return 1;
+        return expiryAfterMs(unix_ms - wall);
+    }
+
+    // Eviction access info in Entry's 24 access bits. LRU: seconds, wrapping
+    // every ~194 days. LFU: minutes of the last decay (16 bits) above an
+    // 8-bit logarithmic counter.
+    uint32_t lruClock()
+    {
+        return static_cast<uint32_t>(nowMs() / 1000) & Entry::ACCESS_MASK;
+    }
+
+    uint32_t lfuMinutes()
+    {
+        return static_cast<uint32_t>(nowMs() / 60000) & 0xFFFF;
+    }
+
+    // Uniform in [0, 1); per thread, since lock-free readers draw too
+    double randomUnit()
+    {
+        thread_local std::minstd_rand rng(std::random_device{}());
+        return std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+    }
+
+    // Strings too large for a slab chunk are copied once into a heap blob
+    // that GETs can share; the rest are borrowed from s, which must outlive
+    // the result. createEntry() puts long borrowed ones in a slab blob.
+    CompactValue encodeString(std::string_view s)
+    {
+        return s.size() > SLAB_BLOB_MAX ? CompactValue::fromBlob(BlobRef::create(s)) : CompactValue::borrow(s);
+    }
+
+    CompactValue encode(const Storage::Value &value)
+    {
+        return std::visit([](const auto &v)
+                          {
+            using T = std::decay_t<decltype(v)>;
+            if constexpr (std::is_same_v<T, int64_t>) return CompactValue::fromInt(v);
+            else if constexpr (std::is_same_v<T, double>) return CompactValue::fromDouble(v);
+            else if constexpr (std::is_same_v<T, bool>) return CompactValue::fromBool(v);
+            else return encodeString(v); }, value);
+    }
+
+    // Same type and same value, without copying a stored string
+    bool equals(const CompactValue &stored, const Storage::Value &value)
+    {
+        return std::visit([&](const auto &v)
+                          {
+            using T = std::decay_t<decltype(v)>;
+            if constexpr (std::is_same_v<T, int64_t>) return stored.type() == CompactValue::Type::Int && stored.asInt() == v;
+            else if constexpr (std::is_same_v<T, double>) return stored.type() == CompactValue::Type::Double && stored.asDouble() == v;
+            else if constexpr (std::is_same_v<T, bool>) return stored.type() == CompactValue::Type::Bool && stored.asBool() == v;
+            else return stored.type() == CompactValue::Type::String && stored.asString() == v; }, value);
+    }
+
+    Storage::Value decode(const CompactValue &value)
+    {
+        switch (value.type())
+        {
+        case CompactValue::Type::Int:
+            return value.asInt();
+        case CompactValue::Type::Double:
+            return value.asDouble();
+        case CompactValue::Type::Bool:
+            return value.asBool();
+        default:
+            return std::string(value.asString());
+        }
+    }
+}
+
+std::optional<EvictionPolicy> parseEvictionPolicy(std::string_view name)
+{
+    for (auto policy : {EvictionPolicy::NoEviction, EvictionPolicy::AllKeysLru, EvictionPolicy::VolatileLru,
+                        EvictionPolicy::AllKeysLfu, EvictionPolicy::VolatileTtl})
+    {
+        if (name == evictionPolicyName(policy))
+            return policy;
+    }
+    return std::nullopt;
+}
+
+const char *evictionPolicyName(EvictionPolicy policy)
+{
+    switch (policy)
+    {
+    case EvictionPolicy::AllKeysLru:
+        return "allkeys-lru";
+    case EvictionPolicy::VolatileLru:
+        return "volatile-lru";
+    case EvictionPolicy::AllKeysLfu:
+        return "allkeys-lfu";
+    case EvictionPolicy::VolatileTtl:
+        return "volatile-ttl";
+    default:
+        return "noeviction";
+    }
+}
+
+std::optional<ReadMode> parseReadMode(std::string_view name)
+{
+    for (auto mode : {ReadMode::LockFree, ReadMode::Shared, ReadMode::Exclusive})
+    {
+        if (name == readModeName(mode))
+            return mode;
+    }
+    return std::nullopt;
+}
+
+const char *readModeName(ReadMode mode)
+{
+    switch (mode)
+    {
+    case ReadMode::Shared:
+        return "shared";
+    case ReadMode::Exclusive:
+        return "exclusive";
+    default:
+        return "lockfree";
+    }
+}
+
+Storage::Storage(const StorageOptions &options) : options_(options), rng_(std::random_device{}())
 {
     // launch background cleaner thread
     cleaner_thread_ = std::thread([this]()
@@ -19,127 +191,864 @@ Storage::~Storage()
     {
         cleaner_thread_.join();
     }
+    clearEntries();
+}
+
+// Drop every entry and the index. Caller holds mtx_ (or is the destructor).
+void Storage::clearEntries()
+{
+    for (Entry *entry : map_)
+        retire(entry);
+    map_.clear();
+    eviction_pool_.clear();
+}
+
+// Free entry once no lock-free reader can hold it. Caller holds mtx_ and
+// has already unlinked it from map_.
+void Storage::retire(Entry *entry)
+{
+    retired_bytes_ += entry->alloc_size;
+    external_bytes_ -= entry->externalSize();
+    retired_.retire(entry, [](void *self, void *object)
+                    {
+        auto *storage = static_cast<Storage *>(self);
+        auto *entry = static_cast<Entry *>(object);
+        storage->retired_bytes_ -= entry->alloc_size;
+        Entry::destroy(storage->slabs_, entry); }, this);
+
+    if (retired_.pending() >= RECLAIM_BATCH)
+        reclaim();
+}
+
+// Caller holds mtx_. A long string that isn't in a blob yet is copied into
+// one carved from the slabs, so GETs can share it and defrag can move it.
+Entry *Storage::createEntry(std::string_view key, const CompactValue &value, uint64_t meta)
+{
+    Entry *entry;
+    if (value.type() == CompactValue::Type::String && !value.isInline() && !value.isBlob() &&
+        value.asString().size() >= BLOB_MIN_SIZE)
+    {
+        Blob *blob = Blob::create(slabs_, freed_blobs_, value.asString());
+        slab_blob_bytes_ += SlabAllocator::sizeClass(Blob::allocSize(blob->size()));
+        entry = Entry::create(slabs_, key, CompactValue::fromBlob(BlobRef::adopt(blob)), meta);
+    }
+    else
+    {
+        entry = Entry::create(slabs_, key, value, meta);
+    }
+    external_bytes_ += entry->externalSize();
+    return entry;
+}
+
+// Caller holds mtx_. Also hands blobs whose last reference was dropped,
+// on whatever thread, back to the slabs.
+void Storage::reclaim()
+{
+    retired_.reclaim();
+    map_.reclaim();
+    if (freed_blobs_.empty())
+        return;
+    freed_blobs_.drain([this](Blob *blob)
+                       {
+        slab_blob_bytes_ -= SlabAllocator::sizeClass(Blob::allocSize(blob->size()));
+        Blob::destroy(slabs_, blob); });
 }
 
 // Store a key-value pair
-void Storage::set(const std::string &key, const Value &value)
+bool Storage::set(std::string_view key, const Value &value)
 {
-    std::lock_guard<std::mutex> lock(mtx_);
-    map_[key] = ValueEntry{value, {}, false};
+    CompactValue encoded = encode(value); // any heap blob copy happens before locking
+    std::lock_guard<std::shared_mutex> lock(mtx_);
+    if (!evictIfNeeded())
+        return false;
+    upsert(key, encoded, 0);
+    return true;
 }
 
-void Storage::set(const std::string &key, const Value &value, int ttl_secs)
+bool Storage::set(std::string_view key, const Value &value, int ttl_secs)
 {
-    std::lock_guard<std::mutex> lock(mtx_);
-    ValueEntry entry;
-    entry.value = value;
-    entry.hasExpiry = true;
-    entry.expiry = std::chrono::steady_clock::now() + std::chrono::seconds(ttl_secs);
-    map_[key] = entry;
+    CompactValue encoded = encode(value); // any heap blob copy happens before locking
+    std::lock_guard<std::shared_mutex> lock(mtx_);
+    if (!evictIfNeeded())
+        return false;
+    upsert(key, encoded, expiryAfter(ttl_secs));
+    return true;
 }
 
-// Retrieve the value for a key
-std::optional<Storage::Value> Storage::get(const std::string &key)
+// One probe either finds the key or claims its slot. The new entry is
+// complete before it is published, so a concurrent reader sees either the
+// old value or the new one; overwrites keep the old entry's meta.
+// Caller holds mtx_.
+void Storage::upsert(std::string_view key, const CompactValue &value, uint64_t expiry_ms)
 {
-    std::lock_guard<std::mutex> lock(mtx_);
-    auto it = map_.find(key);
-    if (it == map_.end())
+    upsert(map_, key, value, expiry_ms);
+}
+
+void Storage::upsert(KeyTable<Entry, EntryKey> &index, std::string_view key, const CompactValue &value,
+                     uint64_t expiry_ms)
+{
+    auto [slot, inserted] = index.insertSlot(key);
+    Entry *old = inserted ? nullptr : *slot;
+
+    Entry *entry = createEntry(key, value, old ? old->loadMeta() : 0);
+    entry->setExpiryMs(expiry_ms);
+    if (old)
     {
-        return std::nullopt;
+        touch(entry);
+    }
+    else
+    {
+        bool lfu = options_.eviction_policy == EvictionPolicy::AllKeysLfu;
+        entry->setAccess(lfu ? lfuMinutes() << 8 | LFU_INIT_VAL : lruClock());
     }
 
-    if (it->second.hasExpiry && std::chrono::steady_clock::now() >= it->second.expiry)
+    KeyTable<Entry, EntryKey>::publish(*slot, entry);
+    if (old)
+        retire(old);
+}
+
+// Erase key if it is still expired. Readers that find an expired
+// entry come here, since only writers may unlink.
+void Storage::eraseIfExpired(std::string_view key)
+{
+    std::lock_guard<std::shared_mutex> lock(mtx_);
+    Entry *entry = map_.find(key);
+    if (entry && entry->expiredAt(nowMs()))
+        retire(map_.erase(key));
+}
+
+// Run fn(i, entry) on the live entry of each keys[i], all under one
+// acquisition of the protection options_.read_mode asks for. Returns how
+// many keys were found. Readers never unlink: expired keys are erased
+// afterwards on the writer path.
+//
+// Lock-free reads must not see part of an MSET: setMany() keeps
+// batch_seq_ odd while it publishes, and a read that starts during a batch
+// or overlaps one is dropped and done again under the shared lock. Entries
+// are looked up first and handed to fn only once the read stands, so fn
+// runs once per key.
+template <typename Fn>
+size_t Storage::readEntries(std::span<const std::string_view> keys, Fn fn)
+{
+    constexpr size_t INLINE_KEYS = 8;
+    Entry *inline_hits[INLINE_KEYS];
+    std::vector<Entry *> heap_hits; // allocates only for long MGETs
+    Entry **hits = inline_hits;
+    if (keys.size() > INLINE_KEYS)
     {
-        // key expired, erase it
-        map_.erase(it);
-        return std::nullopt;
+        heap_hits.resize(keys.size());
+        hits = heap_hits.data();
     }
 
-    return it->second.value;
+    std::vector<size_t> expired; // allocates only if a key did expire
+    auto lookupAll = [&](auto find)
+    {
+        expired.clear();
+        uint64_t now = nowMs();
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            hits[i] = find(keys[i]);
+            if (hits[i] && hits[i]->expiredAt(now))
+            {
+                expired.push_back(i);
+                hits[i] = nullptr;
+            }
+        }
+    };
+    size_t found = 0;
+    auto applyAll = [&]()
+    {
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            if (!hits[i])
+                continue;
+            touch(hits[i]);
+            fn(i, *hits[i]);
+            found++;
+        }
+    };
+    auto findLocked = [this](std::string_view key)
+    { return map_.find(key); };
+
+    switch (options_.read_mode)
+    {
+    case ReadMode::Exclusive:
+    {
+        std::lock_guard<std::shared_mutex> lock(mtx_);
+        lookupAll(findLocked);
+        applyAll();
+        break;
+    }
+    case ReadMode::LockFree:
+    {
+        uint64_t seq = batch_seq_.load(std::memory_order_acquire);
+        if (!(seq & 1))
+        {
+            epoch::Guard guard;
+            lookupAll([this](std::string_view key)
+                      { return map_.findShared(key); });
+            // ordered after the entry loads: if one of them came from a
+            // batch, this sees the batch's count
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (batch_seq_.load(std::memory_order_relaxed) == seq)
+            {
+                applyAll();
+                break;
+            }
+        }
+        [[fallthrough]];
+    }
+    default:
+    {
+        std::shared_lock<std::shared_mutex> lock(mtx_);
+        lookupAll(findLocked);
+        applyAll();
+        break;
+    }
+    }
+
+    for (size_t i : expired)
+        eraseIfExpired(keys[i]);
+    return found;
+}
+
+// Single-key form: fn(entry), false if the key is missing or expired
+template <typename Fn>
+bool Storage::readEntry(std::string_view key, Fn fn)
+{
+    return readEntries({&key, 1}, [&](size_t, const Entry &entry)
+                       { fn(entry); }) != 0;
+}
+
+// Retrieve the value for a key
+std::optional<Storage::Value> Storage::get(std::string_view key)
+{
+    std::optional<Value> value;
+    readEntry(key, [&](const Entry &entry)
+              { value = decode(entry.value); });
+    return value;
+}
+
+// The stored value itself: a blob comes back shared, not copied
+std::optional<CompactValue> Storage::getRef(std::string_view key)
+{
+    std::optional<CompactValue> value;
+    readEntry(key, [&](const Entry &entry)
+              { value = entry.value.owned(); });
+    return value;
+}
+
+// Several keys under one guard or lock; large strings come back shared
+std::vector<std::optional<CompactValue>> Storage::getMany(std::span<const std::string_view> keys)
+{
+    std::vector<std::optional<CompactValue>> values(keys.size());
+    readEntries(keys, [&](size_t i, const Entry &entry)
+                { values[i] = entry.value.owned(); });
+    return values;
+}
+
+// Values are encoded (large ones copied into blobs) before taking the lock,
+// then every pair is applied under one hold of it
+Storage::SetStatus Storage::setMany(std::span<const std::pair<std::string_view, Value>> pairs, bool only_if_none_exist)
+{
+    std::vector<CompactValue> encoded;
+    encoded.reserve(pairs.size());
+    for (const auto &pair : pairs)
+        encoded.push_back(encode(pair.second));
+
+    std::lock_guard<std::shared_mutex> lock(mtx_);
+    if (only_if_none_exist)
+    {
+        uint64_t now = nowMs();
+        for (const auto &pair : pairs)
+        {
+            const Entry *entry = map_.find(pair.first);
+            if (entry && !entry->expiredAt(now))
+                return SetStatus::ConditionFailed;
+        }
+    }
+    if (!evictIfNeeded())
+        return SetStatus::OutOfMemory;
+
+    // lock-free readers that overlap this see none of the batch
+    // (readEntries); the locked ones wait for the writer lock
+    batch_seq_.fetch_add(1, std::memory_order_acq_rel);
+    for (size_t i = 0; i < pairs.size(); i++)
+        upsert(pairs[i].first, encoded[i], 0);
+    batch_seq_.fetch_add(1, std::memory_order_release);
+    return SetStatus::Ok;
+}
+
+Storage::SetStatus Storage::set(std::string_view key, const Value &value, const SetOptions &options,
+                                std::optional<CompactValue> *old)
+{
+    CompactValue encoded = encode(value);
+    std::lock_guard<std::shared_mutex> lock(mtx_);
+
+    Entry *entry = map_.find(key);
+    if (entry && entry->expiredAt(nowMs()))
+        entry = nullptr;
+    if (old)
+        *old = entry ? std::optional<CompactValue>(entry->value.owned()) : std::nullopt;
+
+    if ((options.condition == SetOptions::Condition::IfMissing && entry) ||
+        (options.condition == SetOptions::Condition::IfExists && !entry))
+        return SetStatus::ConditionFailed;
+
+    uint64_t expiry = 0;
+    if (options.keep_ttl)
+        expiry = entry ? entry->expiryMs() : 0;
+    else if (options.ttl_ms)
+        expiry = expiryAfterMs(*options.ttl_ms);
+    if (!evictIfNeeded()) // may evict entry itself, so it isn't used past here
+        return SetStatus::OutOfMemory;
+    upsert(key, encoded, expiry);
+    return SetStatus::Ok;
+}
+
+Storage::SetStatus Storage::compareAndSet(std::string_view key, const Value &expected, const Value &value)
+{
+    CompactValue encoded = encode(value);
+    std::lock_guard<std::shared_mutex> lock(mtx_);
+
+    Entry *entry = map_.find(key);
+    if (!entry || entry->expiredAt(nowMs()) || !equals(entry->value, expected))
+        return SetStatus::ConditionFailed;
+    uint64_t expiry = entry->expiryMs();
+    if (!evictIfNeeded())
+        return SetStatus::OutOfMemory;
+    upsert(key, encoded, expiry);
+    return SetStatus::Ok;
+}
+
+// One probe unlinks the entry; its value is copied out (blobs shared)
+// before the entry is retired
+std::optional<CompactValue> Storage::getDel(std::string_view key)
+{
+    std::lock_guard<std::shared_mutex> lock(mtx_);
+    Entry *entry = map_.erase(key);
+    if (!entry)
+        return std::nullopt;
+    std::optional<CompactValue> value;
+    if (!entry->expiredAt(nowMs()))
+        value = entry->value.owned();
+    retire(entry);
+    return value;
 }
 
 // Delete a key
-// Returns true if a key was removed, false if it wasn't found
-bool Storage::del(const std::string &key)
+// Returns true if a key was removed, false if it wasn't found. An expired
+// entry is unlinked all the same but, as for GET, counts as missing.
+bool Storage::del(std::string_view key)
 {
-    std::lock_guard<std::mutex> lock(mtx_);
-    return map_.erase(key) > 0;
+    std::lock_guard<std::shared_mutex> lock(mtx_);
+    Entry *entry = map_.erase(key);
+    if (!entry)
+        return false;
+    bool live = !entry->expiredAt(nowMs());
+    retire(entry);
+    return live;
 }
 
 // Check if a key exists
-bool Storage::exists(const std::string &key)
+bool Storage::exists(std::string_view key)
 {
-    std::lock_guard<std::mutex> lock(mtx_);
-    auto it = map_.find(key);
-    if (it == map_.end())
-        return false;
+    return readEntry(key, [](const Entry &) {});
+}
 
-    if (it->second.hasExpiry && std::chrono::steady_clock::now() >= it->second.expiry)
+// Increments read and replace the value under the writer lock, so
+// concurrent ones never lose an update. The sum is published as a new
+// entry like any overwrite: lock-free readers see the old number or the
+// new one, never a half-written value.
+Storage::IncrStatus Storage::incrBy(std::string_view key, int64_t delta, int64_t &result)
+{
+    std::lock_guard<std::shared_mutex> lock(mtx_);
+    if (!evictIfNeeded())
+        return IncrStatus::OutOfMemory;
+
+    int64_t current = 0;
+    uint64_t expiry = 0;
+    Entry *entry = map_.find(key);
+    if (entry && !entry->expiredAt(nowMs()))
     {
-        map_.erase(it);
-        return false;
+        if (entry->value.isCounter())
+        {
+            if (!entry->value.counter()->add(delta))
+                return IncrStatus::Overflow;
+            result = entry->value.asInt();
+            return IncrStatus::Ok;
+        }
+        if (entry->value.type() != CompactValue::Type::Int)
+            return IncrStatus::NotNumber;
+        current = entry->value.asInt();
+        expiry = entry->expiryMs();
     }
-    return true;
+
+    if (__builtin_add_overflow(current, delta, &result))
+        return IncrStatus::Overflow;
+    upsert(key, CompactValue::fromInt(result), expiry);
+    return IncrStatus::Ok;
+}
+
+Storage::IncrStatus Storage::incrByFloat(std::string_view key, double delta, double &result)
+{
+    std::lock_guard<std::shared_mutex> lock(mtx_);
+    if (!evictIfNeeded())
+        return IncrStatus::OutOfMemory;
+
+    double current = 0;
+    uint64_t expiry = 0;
+    Entry *entry = map_.find(key);
+    if (entry && !entry->expiredAt(nowMs()))
+    {
+        if (entry->value.type() == CompactValue::Type::Int)
+            current = static_cast<double>(entry->value.asInt());
+        else if (entry->value.type() == CompactValue::Type::Double)
+            current = entry->value.asDouble();
+        else
+            return IncrStatus::NotNumber;
+        expiry = entry->expiryMs();
+    }
+
+    result = current + delta;
+    if (!std::isfinite(result))
+        return IncrStatus::Overflow;
+    upsert(key, CompactValue::fromDouble(result), expiry);
+    return IncrStatus::Ok;
+}
+
+// A key that is already a striped counter is bumped on the read path, with
+// no writer lock: the counter is shared, not copied, so the add lands in
+// the stored value. Only turning a key into a counter takes the lock.
+// result is the count of the cell the add went to, not a sum over every
+// cell (see StripedCounter::add); GET still returns the total.
+Storage::IncrStatus Storage::incrCounter(std::string_view key, int64_t delta, int64_t &result)
+{
+    bool counter = false, overflow = false;
+    readEntry(key, [&](const Entry &entry)
+              {
+        if (!entry.value.isCounter())
+            return;
+        counter = true;
+        overflow = !entry.value.counter()->add(delta, &result); });
+    if (counter)
+        return overflow ? IncrStatus::Overflow : IncrStatus::Ok;
+
+    std::lock_guard<std::shared_mutex> lock(mtx_);
+    if (!evictIfNeeded())
+        return IncrStatus::OutOfMemory;
+
+    int64_t initial = 0;
+    uint64_t expiry = 0;
+    Entry *entry = map_.find(key);
+    if (entry && !entry->expiredAt(nowMs()))
+    {
+        if (entry->value.type() != CompactValue::Type::Int)
+            return IncrStatus::NotNumber;
+        if (entry->value.isCounter()) // made a counter since we looked
+            return entry->value.counter()->add(delta, &result) ? IncrStatus::Ok : IncrStatus::Overflow;
+        initial = entry->value.asInt();
+        expiry = entry->expiryMs();
+    }
+
+    if (__builtin_add_overflow(initial, delta, &result))
+        return IncrStatus::Overflow;
+    upsert(key, CompactValue::fromCounter(StripedCounter::create(result)), expiry);
+    return IncrStatus::Ok;
 }
 
 // Return the number of stored key-value pairs
-// Use std::mutex, so it can lock even in a const method
+// mtx_ is mutable, so it can lock even in a const method
 size_t Storage::size() const
 {
-    std::lock_guard<std::mutex> lock(mtx_);
+    std::shared_lock<std::shared_mutex> lock(mtx_);
     return map_.size();
 }
 
 // If key exists → attaches/updates expiry
-// If key doesn’t exist → returns false (like Redis)
-// Background cleaner thread will remove it when expired
-bool Storage::expire(const std::string &key, int ttl_secs)
+// If key doesn’t exist (or has expired) → returns false (like Redis)
+// Background cleaner thread will remove it when expired; a deadline that
+// has already passed removes it here
+bool Storage::setExpiry(std::string_view key, uint64_t expiry_ms)
 {
-    std::lock_guard<std::mutex> lock(mtx_);
-    auto it = map_.find(key);
-    if (it == map_.end())
+    std::lock_guard<std::shared_mutex> lock(mtx_);
+    uint64_t now = nowMs();
+    Entry *entry = map_.find(key);
+    if (!entry || entry->expiredAt(now))
     {
         return false; // key does not exist
     }
 
-    it->second.hasExpiry = true;
-    it->second.expiry = std::chrono::steady_clock::now() + std::chrono::seconds(ttl_secs);
+    if (expiry_ms <= now)
+        retire(map_.erase(key));
+    else
+        entry->setExpiryMs(expiry_ms);
     return true;
 }
 
+bool Storage::expire(std::string_view key, int ttl_secs)
+{
+    return setExpiry(key, expiryAfter(ttl_secs));
+}
+
+bool Storage::pexpire(std::string_view key, int64_t ttl_ms)
+{
+    return setExpiry(key, expiryAfterMs(ttl_ms));
+}
+
+bool Storage::pexpireAt(std::string_view key, int64_t unix_ms)
+{
+    return setExpiry(key, expiryAtUnixMs(unix_ms));
+}
+
+bool Storage::persist(std::string_view key)
+{
+    std::lock_guard<std::shared_mutex> lock(mtx_);
+    Entry *entry = map_.find(key);
+    if (!entry || !entry->hasExpiry() || entry->expiredAt(nowMs()))
+        return false;
+    entry->setExpiryMs(0);
+    return true;
+}
+
+// A read like GET: the expiry sits in the entry's meta word
+int64_t Storage::pttl(std::string_view key)
+{
+    int64_t ttl = TTL_MISSING;
+    readEntry(key, [&](const Entry &entry)
+              {
+        uint64_t expiry = entry.expiryMs();
+        uint64_t now = nowMs();
+        if (expiry == 0)
+            ttl = TTL_NONE;
+        else
+            ttl = expiry > now ? static_cast<int64_t>(expiry - now) : 0; });
+    return ttl;
+}
+
 // returns the entire map
 std::unordered_map<std::string, Storage::Value> Storage::dump() const {
-    std::lock_guard<std::mutex> lock(mtx_);
+    std::shared_lock<std::shared_mutex> lock(mtx_);
     std::unordered_map<std::string, Value> snapshot;
 
-    auto now = std::chrono::steady_clock::now();
-    for(const auto& [key, val]: map_) {
-        if(val.hasExpiry && now >= val.expiry) continue; // skip expired
-        snapshot[key] = val.value;
+    uint64_t now = nowMs();
+    for(const Entry *entry: map_) {
+        if(entry->expiredAt(now)) continue; // skip expired
+        snapshot[std::string(entry->key())] = decode(entry->value);
     }
     return snapshot;
 }
 
+size_t Storage::scan(size_t cursor, size_t count, std::vector<std::pair<std::string, CompactValue>> &batch)
+{
+    std::shared_lock<std::shared_mutex> lock(mtx_);
+    batch.clear();
+    uint64_t now = nowMs();
+    return map_.scan(cursor, count, [&](Entry *&entry)
+                     {
+        if (!entry->expiredAt(now))
+            batch.emplace_back(std::string(entry->key()), entry->value.owned()); });
+}
+
+Storage::MemoryStats Storage::memoryStats() const
+{
+    std::shared_lock<std::shared_mutex> lock(mtx_);
+    MemoryStats stats;
+    stats.slabs = slabs_.stats();
+    stats.defrag_cycles = defrag_cycles_;
+    stats.defrag_moved = defrag_moved_;
+    stats.defrag_running = defrag_running_;
+    stats.used_memory = usedMemory();
+    stats.maxmemory = options_.maxmemory;
+    stats.eviction_policy = options_.eviction_policy;
+    stats.evicted_keys = evicted_keys_;
+    return stats;
+}
+
+std::optional<size_t> Storage::memoryUsage(std::string_view key) const
+{
+    std::shared_lock<std::shared_mutex> lock(mtx_);
+    const Entry *entry = map_.find(key);
+    if (!entry || entry->expiredAt(nowMs()))
+        return std::nullopt;
+    return entry->alloc_size + entry->externalSize();
+}
+
+/*
+ * Eviction
+ * Used memory is what the slab allocator has handed out for entries (each
+ * rounded to its size class) plus the index. Writes call evictIfNeeded()
+ * first. Victims are picked the way Redis approximates LRU/LFU: every
+ * round samples a few random keys, scores them and merges them into a
+ * small pool of the best candidates seen so far, then evicts the best one
+ * that still exists. Access info lives in each entry's meta bits, so a
+ * read only rewrites its own entry. Caller holds mtx_ for all of these.
+ */
+
+// The index counts at its current capacity: the old table of a resize in
+// flight is transient and would otherwise set off a burst of evictions
+size_t Storage::usedMemory() const
+{
+    return slabs_.allocatedBytes() - slab_blob_bytes_ - retired_bytes_ + external_bytes_ +
+           map_.capacity() * INDEX_SLOT_BYTES;
+}
+
+// LFU counter after decaying it for the minutes the entry sat unused
+uint32_t Storage::lfuCounter(const Entry *entry) const
+{
+    uint32_t counter = entry->access() & 0xFF;
+    uint32_t idle = (lfuMinutes() - (entry->access() >> 8)) & 0xFFFF;
+    uint32_t periods = options_.lfu_decay_minutes ? idle / options_.lfu_decay_minutes : 0;
+    return periods >= counter ? 0 : counter - periods;
+}
+
+// Record an access for the eviction policy. Lock-free readers call this
+// too: it only changes the entry's access bits, atomically.
+void Storage::touch(Entry *entry)
+{
+    if (options_.eviction_policy != EvictionPolicy::AllKeysLfu)
+    {
+        uint32_t clock = lruClock();
+        if (entry->access() != clock) // hot keys mostly skip the write
+            entry->setAccess(clock);
+        return;
+    }
+
+    // logarithmic counter: the higher it is, the less likely a hit bumps it
+    uint32_t counter = lfuCounter(entry);
+    if (counter < 255)
+    {
+        double base = counter > LFU_INIT_VAL ? counter - LFU_INIT_VAL : 0;
+        double p = 1.0 / (base * options_.lfu_log_factor + 1);
+        if (randomUnit() < p)
+            counter++;
+    }
+    // like the LRU clock, a hot key rarely changes its bits: skip the CAS
+    uint32_t access = lfuMinutes() << 8 | counter;
+    if (entry->access() != access)
+        entry->setAccess(access);
+}
+
+uint64_t Storage::evictionScore(const Entry *entry) const
+{
+    switch (options_.eviction_policy)
+    {
+    case EvictionPolicy::AllKeysLfu:
+        return 255 - lfuCounter(entry);
+    case EvictionPolicy::VolatileTtl:
+        return UINT64_MAX - entry->expiryMs();
+    default: // idle seconds
+        return (lruClock() - entry->access()) & Entry::ACCESS_MASK;
+    }
+}
+
+void Storage::fillEvictionPool(const KeyTable<Entry, EntryKey> &index)
+{
+    bool volatileOnly = options_.eviction_policy == EvictionPolicy::VolatileLru ||
+                        options_.eviction_policy == EvictionPolicy::VolatileTtl;
+    size_t samples = std::max(1u, options_.eviction_samples);
+
+    auto consider = [&](const Entry *entry)
+    {
+        if (volatileOnly && !entry->hasExpiry())
+            return false;
+
+        uint64_t score = evictionScore(entry);
+        if (eviction_pool_.size() == EVICTION_POOL_SIZE && score <= eviction_pool_.front().score)
+            return true;
+        for (const auto &candidate : eviction_pool_)
+        {
+            if (candidate.key == entry->key())
+                return true;
+        }
+
+        auto pos = std::upper_bound(eviction_pool_.begin(), eviction_pool_.end(), score,
+                                    [](uint64_t s, const EvictionCandidate &c) { return s < c.score; });
+        eviction_pool_.insert(pos, {score, std::string(entry->key())});
+        if (eviction_pool_.size() > EVICTION_POOL_SIZE)
+            eviction_pool_.erase(eviction_pool_.begin());
+        return true;
+    };
+
+    // when few keys qualify (volatile policies), look further before giving up
+    size_t max_slots = samples * EVICTION_SLOTS_PER_SAMPLE;
+    while (index.sample(rng_(), samples, max_slots, consider) == 0 && max_slots < 2 * index.capacity())
+        max_slots *= 8;
+}
+
+// Evict until used memory is within maxmemory; false if that can't be done
+bool Storage::evictIfNeeded()
+{
+    return evictFrom(map_, 0);
+}
+
+// Same, for a keyspace being built in index: its bytes are what usedMemory()
+// counts beyond outside_bytes, plus index instead of map_
+bool Storage::evictFrom(KeyTable<Entry, EntryKey> &index, size_t outside_bytes)
+{
+    if (options_.maxmemory == 0)
+        return true;
+
+    auto used = [&]
+    {
+        return usedMemory() - outside_bytes + (index.capacity() - map_.capacity()) * INDEX_SLOT_BYTES;
+    };
+    while (used() > options_.maxmemory)
+    {
+        if (options_.eviction_policy == EvictionPolicy::NoEviction)
+            return false;
+
+        Entry *victim = nullptr;
+        while (!victim)
+        {
+            fillEvictionPool(index);
+            if (eviction_pool_.empty())
+                return false; // nothing the policy may evict
+
+            // pooled keys may have been deleted since; skip those
+            while (!victim && !eviction_pool_.empty())
+            {
+                victim = index.erase(eviction_pool_.back().key);
+                eviction_pool_.pop_back();
+            }
+        }
+        retire(victim);
+        evicted_keys_++;
+    }
+    return true;
+}
+
+/*
+ * Active expiry
+ * Keys nobody reads again are removed by the cleaner, a slice of the index
+ * per tick from a cursor that wraps around, so a large keyspace never
+ * stalls writers for a whole sweep. Like Redis' expire cycle, a slice in
+ * which many keys had expired is followed by another while the tick's
+ * budget lasts. Caller holds mtx_.
+ */
+void Storage::expireStep(std::chrono::steady_clock::time_point deadline)
+{
+    std::vector<Entry *> expired; // allocates only if a key did expire
+    do
+    {
+        size_t seen = 0;
+        uint64_t now = nowMs();
+        expired.clear();
+        expire_cursor_ = map_.scan(expire_cursor_, EXPIRE_SLOTS_PER_STEP, [&](Entry *&slot)
+                                   {
+            seen++;
+            if (slot->expiredAt(now))
+                expired.push_back(slot); });
+        for (Entry *entry : expired)
+            retire(map_.erase(entry->key()));
+
+        // mostly live keys: the rest of the walk can wait for the next tick
+        if (expire_cursor_ == 0 || expired.size() * 4 < seen)
+            break;
+    } while (std::chrono::steady_clock::now() < deadline);
+}
+
+/*
+ * Active defragmentation
+ * A cycle marks sparse slabs as draining, then walks the whole index a few
+ * slots at a time, re-creating every entry that sits in a draining slab.
+ * The copy comes from a denser slab and replaces the old pointer in its
+ * slot, so no lookup is needed. Drained slabs are released as they empty.
+ * Caller holds mtx_ for all of these.
+ */
+
+// Start a cycle if enough slab memory is free; true if one is running.
+// The check reads the allocator's running totals, so an idle tick costs
+// O(1); only beginDrain() walks the slabs. Retired entries still occupy
+// their chunks, so callers reclaim() first.
+bool Storage::defragStart()
+{
+    if (defrag_running_)
+        return true;
+
+    size_t slab_bytes = slabs_.slabBytes();
+    size_t free_bytes = slab_bytes - slabs_.slabUsedBytes();
+    if (free_bytes < options_.defrag_ignore_bytes ||
+        free_bytes * 100 < slab_bytes * options_.defrag_threshold_pct)
+        return false;
+    if (slabs_.beginDrain(options_.defrag_slab_fill_pct) == 0)
+        return false;
+
+    defrag_running_ = true;
+    defrag_cursor_ = 0;
+    defrag_cycles_++;
+    return true;
+}
+
+// Relocate until deadline or the end of the cycle; false once it ended
+bool Storage::defragStep(std::chrono::steady_clock::time_point deadline)
+{
+    do
+    {
+        defrag_cursor_ = map_.scan(defrag_cursor_, DEFRAG_SLOTS_PER_STEP, [this](Entry *&slot)
+                                   {
+            const CompactValue &value = slot->value;
+            bool move_blob = value.isBlob() && value.blobPtr()->pooled() &&
+                             slabs_.draining(value.blobPtr(), Blob::allocSize(value.asString().size()));
+            if (!move_blob && !slabs_.draining(slot, slot->alloc_size))
+                return;
+            // a borrowed copy of the bytes makes createEntry() build a fresh
+            // blob; readers still holding the old one keep it until they let go
+            Entry *old = slot;
+            CompactValue moved = move_blob ? CompactValue::borrow(value.asString()) : value;
+            KeyTable<Entry, EntryKey>::publish(slot, createEntry(old->key(), moved, old->loadMeta()));
+            retire(old);
+            defrag_moved_++; });
+
+        if (defrag_cursor_ == 0)
+        {
+            reclaim(); // lets the drained slabs empty out before they are released from draining
+            slabs_.endDrain();
+            defrag_running_ = false;
+            return false;
+        }
+    } while (std::chrono::steady_clock::now() < deadline);
+    return true;
+}
+
+size_t Storage::defragment()
+{
+    std::lock_guard<std::shared_mutex> lock(mtx_);
+    size_t before = defrag_moved_;
+    reclaim();
+    if (defragStart())
+        while (defragStep(std::chrono::steady_clock::time_point::max()))
+        {
+        }
+    return defrag_moved_ - before;
+}
+
 void Storage::cleaner()
 {
+    using namespace std::chrono;
     while (!stop_)
     {
         {
-            std::lock_guard<std::mutex> lock(mtx_);
-            auto now = std::chrono::steady_clock::now();
-            for (auto it = map_.begin(); it != map_.end();)
+            std::lock_guard<std::shared_mutex> lock(mtx_);
+            reclaim(); // returns at once when nothing was retired
+
+            // help a resize in progress along, without holding the lock long
+            auto deadline = steady_clock::now() + REHASH_BUDGET;
+            while (map_.rehashing() && steady_clock::now() < deadline)
             {
-                if (it->second.hasExpiry && now >= it->second.expiry)
-                {
-                    it = map_.erase(it);
-                }
-                else
-                {
-                    ++it;
-                }
+                map_.rehashStep(REHASH_GROUPS_PER_STEP);
             }
+
+            // then a slice of defrag, within its share of the tick
+            if (options_.active_defrag && defragStart())
+            {
+                defragStep(steady_clock::now() + CLEANER_TICK * options_.defrag_cpu_pct / 100);
+            }
+
+            // and the next slice of the expiry walk
+            expireStep(steady_clock::now() + EXPIRE_BUDGET);
         }
-        std::this_thread::sleep_for(std::chrono::seconds(1)); // runs every second
+        std::this_thread::sleep_for(CLEANER_TICK);
     }
 }
 
@@ -150,29 +1059,31 @@ void Storage::cleaner()
 */
 
 bool Storage::saveToFile(const std::string &filename) const {
-    std::lock_guard<std::mutex> lock(mtx_);
+    std::shared_lock<std::shared_mutex> lock(mtx_);
 
     json js;
-    auto now = std::chrono::steady_clock::now();
+    uint64_t now = nowMs();
 
-    for(const auto& [key, entry]: map_) {
+    for(const Entry *item: map_) {
+        const Entry &entry = *item;
         // skip expired keys
-        if(entry.hasExpiry && now >= entry.expiry) continue;
+        if(entry.expiredAt(now)) continue;
 
         json valueJson;
         std::visit([&](auto &&arg) {
             valueJson["value"] = arg;
-        }, entry.value);
+        }, decode(entry.value));
 
-        valueJson["hasExpiry"] = entry.hasExpiry;
-        if(entry.hasExpiry) {
-            auto remaining = std::chrono::duration_cast<std::chrono::seconds>(entry.expiry - now).count();
-            valueJson["ttl_remaining"] = remaining;
+        valueJson["hasExpiry"] = entry.hasExpiry();
+        if(entry.hasExpiry()) {
+            auto remaining_ms = static_cast<int64_t>(entry.expiryMs() - now);
+            valueJson["ttl_remaining"] = remaining_ms / 1000; // read by older builds
+            valueJson["ttl_remaining_ms"] = remaining_ms;
         } else {
             valueJson["ttl_remaining"] = nullptr;
         }
 
-        js[key] = valueJson;
+        js[std::string(entry.key())] = valueJson;
     }
 
     std::ofstream file(filename);
@@ -181,41 +1092,55 @@ bool Storage::saveToFile(const std::string &filename) const {
     return true;
 }
 
-bool Storage::loadFromFile(const std::string &filename) {
-    std::lock_guard<std::mutex> lock(mtx_);
+Storage::LoadStatus Storage::loadFromFile(const std::string &filename) {
+    std::lock_guard<std::shared_mutex> lock(mtx_);
 
     std::ifstream file(filename);
-    if(!file.is_open()) return false;
+    if(!file.is_open()) return LoadStatus::FileError;
 
     json js;
     file >> js;
     file.close();
 
-    map_.clear();
-    auto now = std::chrono::steady_clock::now();
+    // Build the new keyspace beside the current one, which stays untouched
+    // (and readable) until the load has succeeded. maxmemory bounds the new
+    // keyspace alone: the current entries are about to go.
+    KeyTable<Entry, EntryKey> loaded;
+    size_t current_bytes = usedMemory() - map_.capacity() * INDEX_SLOT_BYTES;
+    eviction_pool_.clear();
 
     for(auto it = js.begin(); it != js.end(); it++) {
         const std::string &key = it.key();
         const json &entryJson = it.value();
 
-        ValueEntry entry;
+        CompactValue value;
         const auto &v = entryJson["value"];
 
-        if(v.is_boolean()) entry.value = v.get<bool>();
-        else if(v.is_number_integer()) entry.value = v.get<int>();
-        else if(v.is_number_float()) entry.value = v.get<double>();
-        else if(v.is_string()) entry.value = v.get<std::string>();
+        if(v.is_boolean()) value = CompactValue::fromBool(v.get<bool>());
+        else if(v.is_number_integer()) value = CompactValue::fromInt(v.get<int64_t>());
+        else if(v.is_number_float()) value = CompactValue::fromDouble(v.get<double>());
+        else if(v.is_string()) value = encodeString(v.get_ref<const std::string &>());
 
-        entry.hasExpiry = entryJson.value("hasExpiry", false);
-        if(entry.hasExpiry && !entryJson["ttl_remaining"].is_null()) {
-            int remaining = entryJson["ttl_remaining"];
-            entry.expiry = now + std::chrono::seconds(remaining);
+        uint64_t expiry = 0;
+        if(entryJson.value("hasExpiry", false)) {
+            // an expiry without a remaining TTL has already passed
+            const auto &remaining = entryJson["ttl_remaining"];
+            if(entryJson.contains("ttl_remaining_ms")) expiry = expiryAfterMs(entryJson["ttl_remaining_ms"].get<int64_t>());
+            else expiry = remaining.is_null() ? 1 : expiryAfter(remaining.get<int64_t>());
         }
 
-        map_[key] = entry;
+        if(!evictFrom(loaded, current_bytes)) {
+            for(Entry *entry: loaded) retire(entry);
+            eviction_pool_.clear();
+            return LoadStatus::OutOfMemory;
+        }
+        upsert(loaded, key, value, expiry);
     }
 
-    return true;
+    for(Entry *entry: map_) retire(entry);
+    map_.replace(loaded);
+    eviction_pool_.clear();
+    return LoadStatus::Ok;
 }
 
 
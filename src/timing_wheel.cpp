@@ -0,0 +1,69 @@
+#include "timing_wheel.h"
+
+TimingWheel::TimingWheel(Clock::duration tick, size_t slots, Clock::time_point start)
+    : slots_(slots, nullptr), tick_(tick), last_tick_(start) {}
+
+// caller holds mtx_
+void TimingWheel::unlink(Timer &timer) {
+    if(timer.prev_) timer.prev_->next_ = timer.next_;
+    else slots_[timer.slot_] = timer.next_;
+    if(timer.next_) timer.next_->prev_ = timer.prev_;
+
+    timer.prev_ = timer.next_ = nullptr;
+    timer.scheduled_ = false;
+    pending_--;
+}
+
+void TimingWheel::schedule(Timer &timer, Clock::duration delay) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if(timer.scheduled_) unlink(timer);
+
+    // number of ticks from now, at least one
+    size_t ticks = delay <= Clock::duration::zero()
+        ? 1
+        : static_cast<size_t>((delay + tick_ - Clock::duration(1)) / tick_);
+    if(ticks == 0) ticks = 1;
+
+    timer.slot_ = (cursor_ + ticks) % slots_.size();
+    timer.rounds_ = (ticks - 1) / slots_.size();
+    timer.scheduled_ = true;
+    timer.prev_ = nullptr;
+    timer.next_ = slots_[timer.slot_];
+    if(timer.next_) timer.next_->prev_ = &timer;
+    slots_[timer.slot_] = &timer;
+    pending_++;
+}
+
+void TimingWheel::cancel(Timer &timer) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if(timer.scheduled_) unlink(timer);
+}
+
+size_t TimingWheel::advance(Clock::time_point now) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    size_t fired = 0;
+
+    while(now - last_tick_ >= tick_) {
+        last_tick_ += tick_;
+        cursor_ = (cursor_ + 1) % slots_.size();
+
+        Timer *timer = slots_[cursor_];
+        while(timer) {
+            Timer *next = timer->next_;
+            if(timer->rounds_ > 0) {
+                timer->rounds_--;
+            } else {
+                unlink(*timer);
+                timer->on_expire_();
+                fired++;
+            }
+            timer = next;
+        }
+    }
+    return fired;
+}
+
+size_t TimingWheel::pending() const {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return pending_;
+}
@@ -0,0 +1,505 @@
+/*
+This test file covers command parsing and dispatch:
+
+case-insensitive command lookup
+arity validation from the command table
+COMMAND / COMMAND INFO / COMMAND COUNT
+tokenizing quotes and escapes
+ArgVector spilling past its inline capacity
+value type detection (int64, double, bool, string)
+session data directory created only when SAVE needs it; shm sessions keyed by channel name
+MEMORY SLABS / MEMORY STATS
+GET of a large value streams it from the stored blob
+integer text: shared table for 0..9999, to_chars past it, same replies either way
+INCR / DECR / INCRBY / DECRBY / INCRBYFLOAT replies and errors
+CINCR / CDECR / CINCRBY / CDECRBY on striped counters
+MGET / MSET / MSETNX replies and arity
+SET NX/XX/GET/EX/PX/KEEPTTL, GETSET, GETDEL and CAS
+TTL / PTTL / PERSIST / PEXPIRE / EXPIREAT / PEXPIREAT
+GET / DEL / EXPIRE on missing and expired keys (one Storage call each)
+SHOW and MGET stop at the session's output limit
+*/
+
+#include "../include/command_parser.h"
+#include "../include/storage.h"
+#include "../include/arg_vector.h"
+#include "../include/integer_text.h"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <climits>
+#include <filesystem>
+#include <thread>
+#include <iostream>
+#include <string>
+
+static bool contains(const std::string &reply, const std::string &needle) {
+    return reply.find(needle) != std::string::npos;
+}
+
+void test_dispatch() {
+    Storage store;
+    Session session(0);
+    CommandParser parser(store, session);
+
+    assert(contains(parser.execute("SET a 1"), "OK"));
+    assert(contains(parser.execute("get a"), "1"));
+    assert(contains(parser.execute("ExIsTs a"), "(integer) 1"));
+    assert(contains(parser.execute("display"), "KEY"));
+    assert(contains(parser.execute("del a"), "(integer) 1"));
+    assert(contains(parser.execute("GET a"), "(nil)"));
+
+    assert(contains(parser.execute("SETX a 1"), "unknown command"));
+    assert(contains(parser.execute("GE"), "unknown command"));
+    assert(parser.execute("   ").empty());
+}
+
+void test_arity() {
+    Storage store;
+    Session session(0);
+    CommandParser parser(store, session);
+
+    assert(contains(parser.execute("GET"), "wrong number of arguments"));
+    assert(contains(parser.execute("GET a b"), "wrong number of arguments"));
+    assert(contains(parser.execute("SET a"), "usage: SET <key> <value> [ttl]"));
+    assert(contains(parser.execute("SAVE"), "usage: SAVE <filename>"));
+    assert(contains(parser.execute("EXPIRE a"), "wrong number of arguments"));
+    assert(store.size() == 0);
+}
+
+void test_command_info() {
+    Storage store;
+    Session session(0);
+    CommandParser parser(store, session);
+
+    std::string all = parser.execute("COMMAND");
+    assert(contains(all, "get") && contains(all, "expire") && contains(all, "command"));
+
+    std::string info = parser.execute("command info get set nosuch");
+    assert(contains(info, "1) "));
+    assert(contains(info, "arity 2"));
+    assert(contains(info, "readonly"));
+    assert(contains(info, "arity -3"));
+    assert(contains(info, "write"));
+    assert(contains(info, "3) ") && contains(info, "(nil)"));
+
+    assert(contains(parser.execute("COMMAND COUNT"), "(integer) "));
+    assert(contains(parser.execute("COMMAND BOGUS"), "(error)"));
+}
+
+void test_tokenize() {
+    Storage store;
+    Session session(0);
+    CommandParser parser(store, session);
+
+    parser.execute("SET \"a b\" \"c d\"");
+    assert(std::get<std::string>(*store.get("a b")) == "c d");
+
+    // quoted section glued to a prefix, escapes inside quotes
+    parser.execute("SET pre\"fix key\" \"say \\\"hi\\\" \\\\ there\"");
+    assert(std::get<std::string>(*store.get("prefix key")) == "say \"hi\" \\ there");
+
+    // empty quoted value is still an argument
+    assert(parser.execute("SET empty \"\"").find("OK") != std::string::npos);
+    assert(std::get<std::string>(*store.get("empty")).empty());
+
+    // tabs and repeated spaces separate arguments
+    parser.execute("  SET\tspaced    value  ");
+    assert(std::get<std::string>(*store.get("spaced")) == "value");
+}
+
+void test_arg_vector() {
+    ArgVector args;
+    std::string words[20];
+    for(int i=0; i<20; i++) {
+        words[i] = "w" + std::to_string(i);
+        args.push_back(words[i]);
+        assert(args.spilled() == (i + 1 > static_cast<int>(ArgVector::INLINE_CAPACITY)));
+    }
+    assert(args.size() == 20);
+    for(int i=0; i<20; i++) assert(args[i] == words[i]);
+
+    args.clear();
+    args.push_back("x");
+    assert(args.size() == 1 && !args.spilled() && args[0] == "x");
+
+    // commands with more arguments than the inline capacity still parse
+    Storage store;
+    Session session(0);
+    CommandParser parser(store, session);
+    std::string info = parser.execute("COMMAND INFO get set del exists expire show display save load command get set");
+    assert(contains(info, "12) "));
+}
+
+void test_parse_values() {
+    Storage store;
+    Session session(0);
+    CommandParser parser(store, session);
+
+    parser.execute("SET i -42");
+    parser.execute("SET plus +7");
+    parser.execute("SET big 9007199254740993");      // 2^53 + 1, exact only as an integer
+    parser.execute("SET huge 99999999999999999999"); // beyond int64 -> double
+    parser.execute("SET d 3.25");
+    parser.execute("SET exp 1e3");
+    parser.execute("SET t true");
+    parser.execute("SET s 12abc");
+    parser.execute("SET dash -");
+    parser.execute("SET inf inf");
+
+    assert(std::get<int64_t>(*store.get("i")) == -42);
+    assert(std::get<int64_t>(*store.get("plus")) == 7);
+    assert(std::get<int64_t>(*store.get("big")) == 9007199254740993LL);
+    assert(std::get<double>(*store.get("huge")) == 1e20);
+    assert(std::get<double>(*store.get("d")) == 3.25);
+    assert(std::get<double>(*store.get("exp")) == 1000.0);
+    assert(std::get<bool>(*store.get("t")) == true);
+    assert(std::get<std::string>(*store.get("s")) == "12abc");
+    assert(std::get<std::string>(*store.get("dash")) == "-");
+    assert(std::get<std::string>(*store.get("inf")) == "inf");
+
+    assert(contains(parser.execute("GET big"), "9007199254740993"));
+
+    // malformed TTLs are rejected instead of throwing
+    assert(contains(parser.execute("SET k v soon"), "invalid TTL"));
+    assert(contains(parser.execute("EXPIRE i 1x"), "invalid TTL"));
+    assert(contains(parser.execute("EXPIRE i -5"), "TTL must be positive"));
+}
+
+void test_session_data_dir() {
+    Storage store;
+    Session session(987654);
+    CommandParser parser(store, session);
+    std::filesystem::remove_all(session.dataDir());
+
+    // ordinary commands never touch the filesystem
+    parser.execute("SET a 1");
+    parser.execute("GET a");
+    assert(!std::filesystem::exists(session.dataDir()));
+
+    assert(contains(parser.execute("LOAD missing.json"), "could not load"));
+    assert(!std::filesystem::exists(session.dataDir()));
+
+    assert(contains(parser.execute("SAVE snap.json"), "Saved to " + session.dataPath("snap.json")));
+    assert(std::filesystem::exists(session.dataPath("snap.json")));
+
+    Storage other;
+    CommandParser otherParser(other, session);
+    assert(contains(otherParser.execute("LOAD snap.json"), "Loaded"));
+    assert(std::get<int64_t>(*other.get("a")) == 1);
+
+    std::filesystem::remove_all(session.dataDir());
+
+    // shared memory clients are keyed by channel, not by descriptor
+    Session shm(987654, "chan"), reconnected(42, "chan"), other_channel(987654, "other");
+    assert(shm.dataDir() == reconnected.dataDir());
+    assert(shm.dataDir() != session.dataDir() && shm.dataDir() != other_channel.dataDir());
+}
+
+void test_memory() {
+    Storage store;
+    Session session(0);
+    CommandParser parser(store, session);
+
+    assert(contains(parser.execute("MEMORY SLABS"), "(empty array)"));
+
+    parser.execute("SET short 1");
+    parser.execute("SET long \"" + std::string(200, 'x') + "\"");
+    std::string slabs = parser.execute("memory slabs");
+    assert(contains(slabs, "1) ") && contains(slabs, "2) "));
+    assert(contains(slabs, "chunk 48 ") && contains(slabs, "used 1 "));
+
+    std::string stats = parser.execute("MEMORY STATS");
+    assert(contains(stats, "keys") && contains(stats, "2"));
+    assert(contains(stats, "slab_bytes") && contains(stats, "131072"));
+    assert(contains(stats, "defrag_moved"));
+
+    // a large value's blob is carved from the slabs too
+    parser.execute("SET blob \"" + std::string(1000, 'b') + "\"");
+    assert(contains(parser.execute("MEMORY SLABS"), "chunk 1024 "));
+
+    std::string usage = parser.execute("MEMORY USAGE long");
+    assert(contains(usage, "(integer) ") && !contains(usage, "(integer) 0"));
+    assert(contains(parser.execute("MEMORY USAGE missing"), "(nil)"));
+    assert(contains(parser.execute("MEMORY USAGE"), "wrong number of arguments"));
+    assert(contains(parser.execute("MEMORY STATS extra"), "wrong number of arguments"));
+
+    assert(contains(parser.execute("MEMORY DOCTOR"), "(error)"));
+    assert(contains(parser.execute("MEMORY"), "wrong number of arguments"));
+}
+
+void test_maxmemory() {
+    StorageOptions options;
+    options.maxmemory = 16 * 1024;
+    Storage store(options);
+    Session session(0);
+    CommandParser parser(store, session);
+
+    std::string reply;
+    for(int i=0; i<1000 && !contains(reply, "OOM"); i++) reply = parser.execute("SET key" + std::to_string(i) + " 1");
+    assert(contains(reply, "(error) OOM"));
+    assert(contains(parser.execute("GET key0"), "1"));
+    assert(contains(parser.execute("MEMORY STATS"), "noeviction"));
+}
+
+void test_large_get() {
+    Storage store;
+    Session session(0);
+    CommandParser parser(store, session);
+
+    std::string large(50000, 'v');
+    store.set("big", large);
+
+    OutputBuffer out;
+    parser.execute("GET big", out);
+    std::string reply = out.str();
+    assert(contains(reply, large));
+    assert(reply.size() < large.size() + 32); // just the colour codes around it
+    assert(parser.execute("GET big") == reply);
+}
+
+void test_integer_text() {
+    for(int64_t v: {int64_t(0), int64_t(7), int64_t(42), int64_t(999), int64_t(1000), int64_t(9999)}) {
+        IntegerText text(v);
+        assert(text.shared());
+        assert(text.view() == std::to_string(v));
+        assert(IntegerText(v).view().data() == text.view().data()); // the same shared bytes
+    }
+    for(int64_t v: {int64_t(10000), int64_t(-1), int64_t(123456789), INT64_MAX, INT64_MIN}) {
+        IntegerText text(v);
+        assert(!text.shared());
+        assert(text.view() == std::to_string(v));
+    }
+
+    Storage store;
+    Session session(0);
+    CommandParser parser(store, session);
+    parser.execute("SET small 42");
+    parser.execute("SET large -9223372036854775808");
+    assert(parser.execute("GET small") == "\033[36m42\033[0m");
+    assert(parser.execute("GET large") == "\033[36m-9223372036854775808\033[0m");
+    assert(parser.execute("EXISTS small") == "\033[35m(integer) 1\033[0m");
+}
+
+void test_incr() {
+    Storage store;
+    Session session(0);
+    CommandParser parser(store, session);
+
+    assert(contains(parser.execute("INCR visits"), "(integer) 1"));
+    assert(contains(parser.execute("incrby visits 10"), "(integer) 11"));
+    assert(contains(parser.execute("DECR visits"), "(integer) 10"));
+    assert(contains(parser.execute("DECRBY visits 15"), "(integer) -5"));
+    assert(contains(parser.execute("GET visits"), "-5"));
+
+    assert(contains(parser.execute("INCRBY visits abc"), "not an integer"));
+    assert(contains(parser.execute("INCRBY visits 1.5"), "not an integer"));
+    assert(contains(parser.execute("DECRBY visits -9223372036854775808"), "overflow"));
+    parser.execute("SET top 9223372036854775807");
+    assert(contains(parser.execute("INCR top"), "overflow"));
+    parser.execute("SET name bob");
+    assert(contains(parser.execute("INCR name"), "not an integer"));
+
+    assert(contains(parser.execute("INCRBYFLOAT price 2.5"), "2.5"));
+    assert(contains(parser.execute("INCRBYFLOAT price -0.5"), "2.0"));
+    assert(contains(parser.execute("INCRBYFLOAT price nan"), "not a valid float"));
+    assert(contains(parser.execute("INCRBYFLOAT name 1"), "not a valid float"));
+    assert(contains(parser.execute("INCR"), "usage: INCR <key>"));
+}
+
+void test_cincr() {
+    Storage store;
+    Session session(0);
+    CommandParser parser(store, session);
+
+    assert(contains(parser.execute("CINCR total"), "(integer) 1"));
+    assert(contains(parser.execute("CINCRBY total 99"), "(integer) 100"));
+    assert(contains(parser.execute("CDECR total"), "(integer) 99"));
+    assert(contains(parser.execute("CDECRBY total 9"), "(integer) 90"));
+    assert(contains(parser.execute("INCR total"), "(integer) 91"));
+    assert(contains(parser.execute("GET total"), "91"));
+    assert(contains(parser.execute("CINCRBY total x"), "not an integer"));
+    parser.execute("SET name bob");
+    assert(contains(parser.execute("CINCR name"), "not an integer"));
+}
+
+void test_batch() {
+    Storage store;
+    Session session(0);
+    CommandParser parser(store, session);
+
+    assert(contains(parser.execute("MSET a 1 b \"two words\" c 2.5"), "OK"));
+    std::string reply = parser.execute("MGET a nope b c");
+    assert(contains(reply, "1) \033[36m1"));
+    assert(contains(reply, "2) \033[33m(nil)"));
+    assert(contains(reply, "3) \033[36mtwo words"));
+    assert(contains(reply, "4) \033[36m2.5"));
+    assert(std::count(reply.begin(), reply.end(), '\n') == 3);
+
+    assert(contains(parser.execute("MSETNX a 9 d 4"), "(integer) 0"));
+    assert(contains(parser.execute("GET a"), "1"));
+    assert(contains(parser.execute("EXISTS d"), "(integer) 0"));
+    assert(contains(parser.execute("MSETNX d 4 e 5"), "(integer) 1"));
+    assert(contains(parser.execute("GET e"), "5"));
+
+    std::string big(5000, 'z');
+    parser.execute("MSET big " + big);
+    assert(contains(parser.execute("MGET big a"), big));
+
+    assert(contains(parser.execute("MSET a 1 b"), "usage: MSET"));
+    assert(contains(parser.execute("MSETNX a"), "usage: MSETNX"));
+    assert(contains(parser.execute("MGET"), "usage: MGET"));
+}
+
+void test_conditional() {
+    Storage store;
+    Session session(0);
+    CommandParser parser(store, session);
+
+    assert(contains(parser.execute("SET k 1 XX"), "(nil)"));
+    assert(contains(parser.execute("SET k 1 nx"), "OK"));
+    assert(contains(parser.execute("SET k 2 NX"), "(nil)"));
+    assert(contains(parser.execute("SET k 2 XX GET"), "1"));
+    assert(contains(parser.execute("SET fresh 1 GET"), "(nil)"));
+    assert(contains(parser.execute("SET k 3 EX 60"), "OK"));
+    assert(contains(parser.execute("SET k 4 PX 60000 GET"), "3"));
+    assert(contains(parser.execute("SET k 5 10 NX"), "(nil)")); // positional TTL still works
+    assert(contains(parser.execute("SET k 5 KEEPTTL"), "OK"));
+
+    assert(contains(parser.execute("SET k 1 EX 0"), "invalid expire time"));
+    assert(contains(parser.execute("SET k 1 NX PX"), "syntax error"));
+    assert(contains(parser.execute("SET k 1 NX XX"), "syntax error"));
+    assert(contains(parser.execute("SET k 1 EX 5 KEEPTTL"), "syntax error"));
+    assert(contains(parser.execute("SET k 1 10 EX 5"), "syntax error"));
+    assert(contains(parser.execute("GET k"), "5"));
+
+    assert(contains(parser.execute("GETSET k hello"), "5"));
+    assert(contains(parser.execute("GETSET other x"), "(nil)"));
+    assert(contains(parser.execute("GETDEL k"), "hello"));
+    assert(contains(parser.execute("GETDEL k"), "(nil)"));
+    assert(contains(parser.execute("EXISTS k"), "(integer) 0"));
+
+    parser.execute("SET n 10");
+    assert(contains(parser.execute("CAS n 9 11"), "(integer) 0"));
+    assert(contains(parser.execute("CAS n 10 11"), "(integer) 1"));
+    assert(contains(parser.execute("GET n"), "11"));
+    assert(contains(parser.execute("CAS nope 1 2"), "(integer) 0"));
+    assert(contains(parser.execute("CAS n 11"), "usage: CAS"));
+}
+
+void test_ttl() {
+    Storage store;
+    Session session(0);
+    CommandParser parser(store, session);
+
+    parser.execute("SET k v");
+    assert(contains(parser.execute("TTL k"), "(integer) -1"));
+    assert(contains(parser.execute("PTTL nope"), "(integer) -2"));
+    assert(contains(parser.execute("PEXPIRE k 5000"), "(integer) 1"));
+    assert(contains(parser.execute("TTL k"), "(integer) 5"));
+    assert(contains(parser.execute("PERSIST k"), "(integer) 1"));
+    assert(contains(parser.execute("PERSIST k"), "(integer) 0"));
+    assert(contains(parser.execute("PEXPIRE nope 10"), "(integer) 0"));
+
+    assert(contains(parser.execute("EXPIREAT k 4102444800"), "(integer) 1")); // 2100-01-01
+    assert(!contains(parser.execute("TTL k"), "-"));
+    assert(contains(parser.execute("PEXPIREAT k 1000"), "(integer) 1"));      // 1970: gone
+    assert(contains(parser.execute("EXISTS k"), "(integer) 0"));
+
+    parser.execute("SET s v PX 100");
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    assert(contains(parser.execute("GET s"), "(nil)"));
+
+    assert(contains(parser.execute("PEXPIRE k x"), "invalid TTL"));
+    assert(contains(parser.execute("EXPIREAT k 9223372036854775807"), "invalid timestamp"));
+    assert(contains(parser.execute("EXPIREAT k -9223372036854775807"), "invalid timestamp"));
+
+    // deadlines already past delete the key, like in Redis
+    for(const char *cmd: {"PEXPIRE k 0", "PEXPIRE k -5", "EXPIREAT k -1", "PEXPIREAT k -9223372036854775807"}) {
+        parser.execute("SET k v");
+        assert(contains(parser.execute(cmd), "(integer) 1"));
+        assert(contains(parser.execute("EXISTS k"), "(integer) 0"));
+        assert(contains(parser.execute(cmd), "(integer) 0"));
+    }
+}
+
+void test_single_lookup() {
+    Storage store;
+    Session session(0);
+    CommandParser parser(store, session);
+
+    assert(contains(parser.execute("GET nope"), "(nil) no such key"));
+    assert(contains(parser.execute("DEL nope"), "(nil) no such key"));
+    assert(contains(parser.execute("EXPIRE nope 10"), "(nil) no such key to expire"));
+    assert(contains(parser.execute("EXPIRE nope x"), "invalid TTL")); // checked before the lookup
+
+    parser.execute("SET k v PX 20");
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    assert(contains(parser.execute("EXPIRE k 10"), "no such key to expire"));
+    assert(contains(parser.execute("GET k"), "(nil) no such key"));
+    parser.execute("SET k v PX 20");
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    assert(contains(parser.execute("DEL k"), "(nil) no such key"));
+
+    parser.execute("SET k v");
+    assert(contains(parser.execute("EXPIRE k 10"), "(integer) 1"));
+    assert(contains(parser.execute("GET k"), "v"));
+    assert(contains(parser.execute("DEL k"), "(integer) 1"));
+    assert(contains(parser.execute("DEL k"), "(nil) no such key"));
+}
+
+void test_output_limit() {
+    Storage store;
+    Session session(0);
+    CommandParser parser(store, session);
+    for(int i=0; i<2000; i++) store.set("key:" + std::to_string(i), i);
+
+    // no limit: every row
+    std::string all = parser.execute("SHOW");
+    assert(std::count(all.begin(), all.end(), '\n') == 2000 + 3);
+
+    // a limit stops the rows within a batch of it
+    session.setOutputLimit(4096);
+    std::string cut = parser.execute("SHOW");
+    assert(contains(cut, "exceeds the client output limit"));
+    assert(cut.size() < 4096 + 256 * 64); // rows here are well under 64 bytes
+
+    std::string mget = "MGET";
+    for(int i=0; i<2000; i++) mget += " key:" + std::to_string(i);
+    std::string reply = parser.execute(mget);
+    assert(contains(reply, "exceeds the client output limit"));
+    assert(reply.size() < 4096 + 256);
+
+    assert(contains(parser.execute("GET key:1"), "1")); // small replies are unaffected
+}
+
+int main(int argc, char **argv) {
+    struct { const char *name; void (*fn)(); } tests[] = {
+        {"dispatch", test_dispatch},
+        {"arity", test_arity},
+        {"command_info", test_command_info},
+        {"tokenize", test_tokenize},
+        {"arg_vector", test_arg_vector},
+        {"parse_values", test_parse_values},
+        {"session_data_dir", test_session_data_dir},
+        {"memory", test_memory},
+        {"maxmemory", test_maxmemory},
+        {"large_get", test_large_get},
+        {"integer_text", test_integer_text},
+        {"incr", test_incr},
+        {"cincr", test_cincr},
+        {"batch", test_batch},
+        {"conditional", test_conditional},
+        {"ttl", test_ttl},
+        {"single_lookup", test_single_lookup},
+        {"output_limit", test_output_limit},
+    };
+
+    for(const auto &t: tests) {
+        if(argc > 1 && std::strcmp(argv[1], t.name) != 0) continue;
+        t.fn();
+        std::cout << t.name << " passed\n";
+    }
+    return 0;
+}
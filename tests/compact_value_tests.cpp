@@ -0,0 +1,144 @@
+/*
+This test file covers the 16-byte tagged value Storage keeps values in:
+
+ints, doubles and bools round-trip
+strings up to 15 bytes stay inline, longer ones move out of line
+copy and move keep (or hand over) the out-of-line buffer
+assignment between different types
+blob values share one reference-counted buffer instead of copying it
+*/
+
+#include "../include/compact_value.h"
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <utility>
+
+using Type = CompactValue::Type;
+
+void test_scalars() {
+    CompactValue i = CompactValue::fromInt(std::numeric_limits<int64_t>::min());
+    assert(i.type() == Type::Int);
+    assert(i.asInt() == std::numeric_limits<int64_t>::min());
+
+    CompactValue d = CompactValue::fromDouble(-2.5);
+    assert(d.type() == Type::Double);
+    assert(d.asDouble() == -2.5);
+
+    CompactValue t = CompactValue::fromBool(true);
+    CompactValue f = CompactValue::fromBool(false);
+    assert(t.type() == Type::Bool && t.asBool());
+    assert(f.type() == Type::Bool && !f.asBool());
+
+    CompactValue empty;
+    assert(empty.type() == Type::String);
+    assert(empty.asString().empty());
+}
+
+void test_strings() {
+    std::string fits(CompactValue::INLINE_CAPACITY, 'x');
+    CompactValue small = CompactValue::fromString(fits);
+    assert(small.type() == Type::String);
+    assert(small.isInline());
+    assert(small.asString() == fits);
+
+    std::string spills = fits + "y";
+    CompactValue large = CompactValue::fromString(spills);
+    assert(large.type() == Type::String);
+    assert(!large.isInline());
+    assert(large.asString() == spills);
+
+    // embedded NULs are kept
+    std::string binary("a\0b", 3);
+    assert(CompactValue::fromString(binary).asString() == binary);
+}
+
+void test_copy_move() {
+    std::string text(100, 'z');
+    CompactValue original = CompactValue::fromString(text);
+
+    CompactValue copy(original);
+    assert(copy.asString() == text);
+    assert(copy.asString().data() != original.asString().data());
+
+    const char *buffer = original.asString().data();
+    CompactValue moved(std::move(original));
+    assert(moved.asString().data() == buffer);
+    assert(moved.asString() == text);
+
+    CompactValue assigned;
+    assigned = moved;
+    assert(assigned.asString() == text);
+    assigned = assigned; // self-assignment keeps the value
+    assert(assigned.asString() == text);
+}
+
+void test_reassign() {
+    CompactValue v = CompactValue::fromString(std::string(40, 'a'));
+    v = CompactValue::fromInt(7);
+    assert(v.type() == Type::Int && v.asInt() == 7);
+    assert(v.isInline());
+
+    v = CompactValue::fromString("short");
+    assert(v.asString() == "short");
+    v = CompactValue::fromString(std::string(20, 'b'));
+    assert(v.asString() == std::string(20, 'b'));
+    v = CompactValue::fromDouble(1.0);
+    assert(v.type() == Type::Double && v.asDouble() == 1.0);
+}
+
+void test_blobs() {
+    std::string text(1000, 'q');
+    BlobRef blob = BlobRef::create(text);
+    const Blob *raw = blob.get();
+    assert(raw->refs() == 1 && blob.view() == text);
+
+    CompactValue v = CompactValue::fromBlob(blob);
+    assert(v.isBlob() && !v.isInline());
+    assert(v.type() == Type::String && v.asString() == text);
+    assert(raw->refs() == 2);
+
+    // copies share the bytes
+    {
+        CompactValue copy(v);
+        assert(copy.asString().data() == v.asString().data());
+        assert(raw->refs() == 3);
+        assert(v.owned().asString().data() == raw->data());
+    }
+    assert(raw->refs() == 2);
+
+    BlobRef shared = v.blob();
+    assert(shared.get() == raw && raw->refs() == 3);
+
+    // the blob outlives the value that held it
+    v = CompactValue::fromInt(1);
+    blob.reset();
+    assert(raw->refs() == 1 && shared.view() == text);
+
+    // owned() copies borrowed bytes, so they may go away afterwards
+    std::string borrowed(30, 'b');
+    CompactValue b = CompactValue::borrow(borrowed);
+    assert(b.isBorrowed());
+    CompactValue own = b.owned();
+    assert(!own.isBorrowed() && own.asString() == borrowed);
+    assert(own.asString().data() != borrowed.data());
+}
+
+int main(int argc, char **argv) {
+    struct { const char *name; void (*fn)(); } tests[] = {
+        {"scalars", test_scalars},
+        {"strings", test_strings},
+        {"copy_move", test_copy_move},
+        {"reassign", test_reassign},
+        {"blobs", test_blobs},
+    };
+
+    for(const auto &t: tests) {
+        if(argc > 1 && std::strcmp(argv[1], t.name) != 0) continue;
+        t.fn();
+        std::cout << t.name << " passed\n";
+    }
+    return 0;
+}
@@ -0,0 +1,111 @@
+/*
+This test file covers the flat keyspace entry:
+
+key and inline value share one allocation
+long string values are stored after the key
+size classes and refilling an entry before it is published
+packed expiry next to the access bits
+*/
+
+#include "../include/entry.h"
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+void test_layout() {
+    Entry *e = Entry::create("user:1", CompactValue::fromInt(42));
+    assert(e->key() == "user:1");
+    assert(e->value.asInt() == 42);
+    assert(e->alloc_size == 48); // 32-byte header + 6-byte key, rounded to 16
+    assert(e->key().data() == reinterpret_cast<const char *>(e) + sizeof(Entry));
+    Entry::destroy(e);
+
+    Entry *empty = Entry::create("", CompactValue());
+    assert(empty->key().empty());
+    assert(empty->value.asString().empty());
+    Entry::destroy(empty);
+}
+
+void test_long_value() {
+    std::string key = "session";
+    std::string text(300, 'v');
+    Entry *e = Entry::create(key, CompactValue::fromString(text));
+    assert(e->value.asString() == text);
+
+    // the value sits right after the key inside the entry
+    const char *base = reinterpret_cast<const char *>(e);
+    assert(e->value.asString().data() == base + sizeof(Entry) + key.size());
+    assert(e->alloc_size >= sizeof(Entry) + key.size() + text.size());
+    Entry::destroy(e);
+}
+
+void test_size_classes() {
+    assert(Entry::sizeClass(1) == 16);
+    assert(Entry::sizeClass(33) == 48);
+    assert(Entry::sizeClass(128) == 128);
+    assert(Entry::sizeClass(129) == 160);
+    assert(Entry::sizeClass(257) == 320);
+    assert(Entry::sizeClass(1000) == 1024);
+    for(size_t n=1; n<5000; n++) assert(Entry::sizeClass(n) >= n);
+}
+
+void test_overwrite() {
+    Entry *e = Entry::create("k", CompactValue::fromString(std::string(40, 'a')));
+    uint32_t size = e->alloc_size;
+
+    // not published yet, so the value may change: a shorter string and a
+    // scalar both fit the existing allocation
+    CompactValue shorter = CompactValue::fromString(std::string(20, 'b'));
+    assert(e->fits(shorter));
+    e->setValue(shorter);
+    assert(e->value.asString() == std::string(20, 'b'));
+
+    e->setValue(CompactValue::fromDouble(0.5));
+    assert(e->value.asDouble() == 0.5);
+    assert(e->alloc_size == size);
+
+    // a much longer one does not
+    assert(!e->fits(CompactValue::fromString(std::string(500, 'c'))));
+    Entry::destroy(e);
+}
+
+void test_meta() {
+    Entry *e = Entry::create("k", CompactValue::fromBool(true), uint64_t(0xABCDEF) << Entry::ACCESS_SHIFT);
+    assert(!e->hasExpiry());
+    assert(e->access() == 0xABCDEF);
+
+    e->setExpiryMs(5000);
+    assert(e->expiryMs() == 5000);
+    assert(e->access() == 0xABCDEF); // access info survives
+    e->setAccess(0x123456);
+    assert(e->expiryMs() == 5000 && e->access() == 0x123456);
+    assert(!e->expiredAt(4999));
+    assert(e->expiredAt(5000));
+
+    // far-off deadlines saturate instead of wrapping into the past
+    e->setExpiryMs(UINT64_MAX - 1);
+    assert(e->expiryMs() == Entry::EXPIRY_MASK && e->access() == 0x123456);
+
+    e->setExpiryMs(0);
+    assert(!e->hasExpiry());
+    assert(!e->expiredAt(UINT64_MAX));
+    Entry::destroy(e);
+}
+
+int main(int argc, char **argv) {
+    struct { const char *name; void (*fn)(); } tests[] = {
+        {"layout", test_layout},
+        {"long_value", test_long_value},
+        {"size_classes", test_size_classes},
+        {"overwrite", test_overwrite},
+        {"meta", test_meta},
+    };
+
+    for(const auto &t: tests) {
+        if(argc > 1 && std::strcmp(argv[1], t.name) != 0) continue;
+        t.fn();
+        std::cout << t.name << " passed\n";
+    }
+    return 0;
+}
@@ -0,0 +1,150 @@
+/*
+This test file covers epoch-based reclamation:
+
+retired objects are freed by reclaim() when no reader is pinned
+a reader pinned before the retire holds the object until its guard ends
+nested guards keep the outer pin
+more readers than a block of slots: none waits, and an overflow reader still holds objects back
+*/
+
+#include "../include/epoch.h"
+#include <atomic>
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+static void countFree(void *counter, void *) {
+    ++*static_cast<int *>(counter);
+}
+
+void test_reclaim() {
+    int freed = 0;
+    epoch::RetireList list;
+    assert(list.reclaim() == 0);
+
+    int a = 0, b = 0;
+    list.retire(&a, countFree, &freed);
+    list.retire(&b, countFree, &freed);
+    assert(list.pending() == 2 && freed == 0);
+
+    assert(list.reclaim() == 2);
+    assert(freed == 2 && list.pending() == 0);
+
+    // whatever is left goes with the list
+    {
+        epoch::RetireList scoped;
+        scoped.retire(&a, countFree, &freed);
+    }
+    assert(freed == 3);
+}
+
+void test_pinned() {
+    int freed = 0;
+    int object = 0;
+    epoch::RetireList list;
+
+    std::atomic<int> stage{0};
+    std::thread reader([&]() {
+        epoch::Guard guard;
+        stage = 1;
+        while(stage != 2) std::this_thread::yield();
+    });
+    while(stage != 1) std::this_thread::yield();
+
+    // the reader pinned before the retire, so it may still use the object
+    list.retire(&object, countFree, &freed);
+    assert(list.reclaim() == 0 && freed == 0);
+
+    // a reader that starts after the retire doesn't hold it back
+    std::atomic<int> late_stage{0};
+    std::thread late([&]() {
+        epoch::Guard guard;
+        late_stage = 1;
+        while(late_stage != 2) std::this_thread::yield();
+    });
+    stage = 2;
+    reader.join();
+    while(late_stage != 1) std::this_thread::yield();
+    assert(list.reclaim() == 1 && freed == 1);
+
+    late_stage = 2;
+    late.join();
+}
+
+void test_nested() {
+    int freed = 0;
+    int object = 0;
+    epoch::RetireList list;
+
+    std::atomic<int> stage{0};
+    std::thread reader([&]() {
+        epoch::Guard outer;
+        {
+            epoch::Guard inner;
+        }
+        // still pinned after the inner guard ends
+        stage = 1;
+        while(stage != 2) std::this_thread::yield();
+    });
+    while(stage != 1) std::this_thread::yield();
+
+    list.retire(&object, countFree, &freed);
+    assert(list.reclaim() == 0);
+    stage = 2;
+    reader.join();
+    assert(list.reclaim() == 1 && freed == 1);
+}
+
+void test_many_readers() {
+    int freed = 0;
+    int object = 0;
+    epoch::RetireList list;
+
+    // fill the first block of slots with readers that stay pinned
+    std::atomic<size_t> pinned{0};
+    std::atomic<bool> release_fillers{false}, release_last{false};
+    std::vector<std::thread> fillers;
+    for(size_t i=0; i<epoch::READERS_PER_BLOCK; i++) {
+        fillers.emplace_back([&]() {
+            epoch::Guard guard;
+            pinned++;
+            while(!release_fillers) std::this_thread::yield();
+        });
+    }
+    while(pinned != epoch::READERS_PER_BLOCK) std::this_thread::yield();
+
+    // one more reader gets a slot in a new block instead of waiting
+    std::thread last([&]() {
+        epoch::Guard guard;
+        pinned++;
+        while(!release_last) std::this_thread::yield();
+    });
+    while(pinned != epoch::READERS_PER_BLOCK + 1) std::this_thread::yield();
+
+    list.retire(&object, countFree, &freed);
+    release_fillers = true;
+    for(auto &t: fillers) t.join();
+    assert(list.reclaim() == 0 && freed == 0); // the reader in the new block is still pinned
+
+    release_last = true;
+    last.join();
+    assert(list.reclaim() == 1 && freed == 1);
+}
+
+int main(int argc, char **argv) {
+    struct { const char *name; void (*fn)(); } tests[] = {
+        {"reclaim", test_reclaim},
+        {"pinned", test_pinned},
+        {"nested", test_nested},
+        {"many_readers", test_many_readers},
+    };
+
+    for(const auto &t: tests) {
+        if(argc > 1 && std::strcmp(argv[1], t.name) != 0) continue;
+        t.fn();
+        std::cout << t.name << " passed\n";
+    }
+    return 0;
+}
@@ -0,0 +1,379 @@
+/*
+This test file covers the open-addressing key table behind Storage:
+
+insert, find and overwrite through insertSlot
+erase by key and tombstone reuse
+growth across many rehashes
+iteration with erase while walking the table
+lookups that must probe past a full group
+incremental resize: lookups, erases and iteration span both tables
+resumable scan that swaps entries in place
+replace: one table takes over another's entries, mid-resize included
+sampling from a random slot, with a filter and a walk limit
+findShared() from reader threads while the writer inserts, resizes and erases
+*/
+
+#include "../include/key_table.h"
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct Item {
+    std::string key;
+    int value;
+};
+
+struct ItemKey {
+    std::string_view operator()(const Item *item) const { return item->key; }
+};
+
+using Table = KeyTable<Item, ItemKey>;
+
+// Owns the items so tests don't leak
+struct Pool {
+    std::vector<std::unique_ptr<Item>> items;
+    Item *make(std::string key, int value) {
+        items.push_back(std::make_unique<Item>(Item{std::move(key), value}));
+        return items.back().get();
+    }
+};
+
+void test_insert_find() {
+    Table table;
+    Pool pool;
+    assert(table.find("missing") == nullptr);
+
+    auto [slot, inserted] = table.insertSlot("alpha");
+    assert(inserted);
+    *slot = pool.make("alpha", 1);
+
+    auto [again, insertedAgain] = table.insertSlot("alpha");
+    assert(!insertedAgain);
+    assert(*again == *slot);
+    (*again)->value = 2;
+
+    assert(table.size() == 1);
+    assert(table.find("alpha")->value == 2);
+    assert(table.find("alph") == nullptr);
+    assert(table.find("") == nullptr);
+}
+
+void test_erase() {
+    Table table;
+    Pool pool;
+    for(int i=0; i<100; i++) {
+        std::string key = "key" + std::to_string(i);
+        *table.insertSlot(key).first = pool.make(key, i);
+    }
+
+    for(int i=0; i<100; i+=2) {
+        Item *removed = table.erase("key" + std::to_string(i));
+        assert(removed && removed->value == i);
+    }
+    assert(table.erase("key0") == nullptr);
+    assert(table.size() == 50);
+
+    for(int i=0; i<100; i++) {
+        Item *item = table.find("key" + std::to_string(i));
+        assert((item != nullptr) == (i % 2 == 1));
+    }
+
+    // churn at a fixed size must not grow the table without bound
+    size_t capacity = table.capacity();
+    for(int round=0; round<50; round++) {
+        for(int i=0; i<100; i+=2) {
+            std::string key = "key" + std::to_string(i);
+            *table.insertSlot(key).first = pool.make(key, i);
+        }
+        for(int i=0; i<100; i+=2) table.erase("key" + std::to_string(i));
+    }
+    assert(table.size() == 50);
+    assert(table.capacity() == capacity);
+}
+
+void test_growth() {
+    Table table;
+    Pool pool;
+    const int N = 100000;
+    for(int i=0; i<N; i++) {
+        std::string key = "user:" + std::to_string(i);
+        auto [slot, inserted] = table.insertSlot(key);
+        assert(inserted);
+        *slot = pool.make(key, i);
+    }
+    assert(table.size() == N);
+    assert(table.capacity() >= N);
+
+    for(int i=0; i<N; i++) {
+        Item *item = table.find("user:" + std::to_string(i));
+        assert(item && item->value == i);
+    }
+    assert(table.find("user:" + std::to_string(N)) == nullptr);
+}
+
+void test_iterate() {
+    Table table;
+    Pool pool;
+    for(int i=0; i<1000; i++) {
+        std::string key = std::to_string(i);
+        *table.insertSlot(key).first = pool.make(key, i);
+    }
+
+    std::set<int> seen;
+    for(const Item *item: table) seen.insert(item->value);
+    assert(seen.size() == 1000);
+
+    // drop the odd values while walking
+    for(auto it = table.begin(); it != table.end();) {
+        if((*it)->value % 2) it = table.erase(it);
+        else ++it;
+    }
+    assert(table.size() == 500);
+
+    int count = 0;
+    for(const Item *item: table) {
+        assert(item->value % 2 == 0);
+        count++;
+    }
+    assert(count == 500);
+
+    table.clear();
+    assert(table.empty());
+    assert(table.begin() == table.end());
+}
+
+void test_collisions() {
+    // fill well past one group so probes have to move on to later groups
+    Table table;
+    Pool pool;
+    table.reserve(40);
+    size_t capacity = table.capacity();
+    for(int i=0; i<static_cast<int>(capacity * 7 / 8); i++) {
+        std::string key(static_cast<size_t>(i % 7) + 1, static_cast<char>('a' + i % 26));
+        key += std::to_string(i);
+        *table.insertSlot(key).first = pool.make(key, i);
+    }
+    assert(table.capacity() == capacity);
+
+    for(const auto &item: pool.items) {
+        assert(table.find(item->key) == item.get());
+    }
+
+    // erasing from full groups leaves tombstones that lookups must skip
+    for(size_t i=0; i<pool.items.size(); i+=3) table.erase(pool.items[i]->key);
+    for(size_t i=0; i<pool.items.size(); i++) {
+        Item *found = table.find(pool.items[i]->key);
+        assert((found == nullptr) == (i % 3 == 0));
+    }
+}
+
+void test_incremental() {
+    Table table;
+    Pool pool;
+    int n = 0;
+    auto add = [&]() {
+        std::string key = "k" + std::to_string(n);
+        *table.insertSlot(key).first = pool.make(key, n);
+        n++;
+    };
+
+    // grow until a resize is left in flight
+    while(!table.rehashing()) add();
+    assert(table.capacity() >= 2048);
+
+    for(int i=0; i<n; i++) {
+        Item *item = table.find("k" + std::to_string(i));
+        assert(item && item->value == i);
+    }
+    size_t seen = 0;
+    for(const Item *item: table) {
+        (void)item;
+        seen++;
+    }
+    assert(seen == static_cast<size_t>(n));
+
+    // mix erases and overwrites with the migration
+    for(int i=0; i<n; i+=5) assert(table.erase("k" + std::to_string(i)));
+    for(int i=1; i<n; i+=5) {
+        auto [slot, inserted] = table.insertSlot("k" + std::to_string(i));
+        assert(!inserted);
+        (*slot)->value = -i;
+    }
+
+    // idle ticks finish the job
+    while(table.rehashing()) table.rehashStep(4);
+    assert(table.rehashStep(4) == 0);
+
+    assert(table.size() == static_cast<size_t>(n - (n + 4) / 5));
+    for(int i=0; i<n; i++) {
+        Item *item = table.find("k" + std::to_string(i));
+        if(i % 5 == 0) assert(item == nullptr);
+        else if(i % 5 == 1) assert(item && item->value == -i);
+        else assert(item && item->value == i);
+    }
+
+    // inserts alone also drive a resize to completion
+    int before = n;
+    while(!table.rehashing()) add();
+    while(table.rehashing()) add();
+    for(int i=0; i<n; i++) {
+        bool erased = i < before && i % 5 == 0;
+        assert((table.find("k" + std::to_string(i)) == nullptr) == erased);
+    }
+}
+
+void test_scan() {
+    Table table;
+    Pool pool;
+    for(int i=0; i<1000; i++) {
+        std::string key = "k" + std::to_string(i);
+        *table.insertSlot(key).first = pool.make(key, i);
+    }
+
+    // replace every entry with a copy, a few slots at a time
+    size_t cursor = 0, visited = 0;
+    do {
+        cursor = table.scan(cursor, 37, [&](Item *&slot) {
+            slot = pool.make(slot->key, slot->value + 1);
+            visited++;
+        });
+    } while(cursor != 0);
+
+    assert(visited == 1000);
+    for(int i=0; i<1000; i++) {
+        Item *item = table.find("k" + std::to_string(i));
+        assert(item && item->value == i + 1);
+    }
+}
+
+void test_replace() {
+    Table table, staged;
+    Pool pool;
+    for(int i=0; i<100; i++) {
+        std::string key = "old" + std::to_string(i);
+        *table.insertSlot(key).first = pool.make(key, i);
+    }
+    // enough keys that staged is still migrating a resize when it is handed over
+    for(int i=0; i<2000; i++) {
+        std::string key = "new" + std::to_string(i);
+        *staged.insertSlot(key).first = pool.make(key, i);
+    }
+    bool migrating = staged.rehashing();
+
+    table.replace(staged);
+    assert(staged.empty() && staged.capacity() == 0 && staged.find("new0") == nullptr);
+    assert(table.size() == 2000 && table.rehashing() == migrating);
+    assert(table.find("old0") == nullptr);
+    for(int i=0; i<2000; i++) {
+        std::string key = "new" + std::to_string(i);
+        Item *item = table.find(key);
+        assert(item && item->value == i);
+        epoch::Guard guard;
+        assert(table.findShared(key) == item);
+    }
+
+    // both tables stay usable
+    *staged.insertSlot("again").first = pool.make("again", 1);
+    assert(staged.find("again")->value == 1);
+    table.erase("new0");
+    assert(table.size() == 1999);
+}
+
+void test_sample() {
+    Table table;
+    Pool pool;
+    assert(table.sample(0, 5, 100, [](const Item *) { return true; }) == 0);
+
+    for(int i=0; i<1000; i++) {
+        std::string key = "k" + std::to_string(i);
+        *table.insertSlot(key).first = pool.make(key, i);
+    }
+
+    // any start works and wraps around; samples are distinct entries
+    for(size_t start: {size_t(0), size_t(12345), SIZE_MAX}) {
+        std::set<int> seen;
+        size_t n = table.sample(start, 5, SIZE_MAX, [&](const Item *item) {
+            seen.insert(item->value);
+            return true;
+        });
+        assert(n == 5 && seen.size() == 5);
+    }
+
+    // only accepted entries count; the walk stops at the limit
+    size_t odd = table.sample(7, 10, SIZE_MAX, [](const Item *item) { return item->value % 2 == 1; });
+    assert(odd == 10);
+    size_t none = table.sample(7, 10, 64, [](const Item *) { return false; });
+    assert(none == 0);
+}
+
+void test_shared_readers() {
+    Table table;
+    Pool pool;
+    const int N = 200000;
+    pool.items.reserve(N);
+    std::atomic<int> published{0}; // keys below this are in the table (odd ones until erased)
+    std::atomic<bool> done{false};
+    std::atomic<long> lookups{0};
+
+    std::vector<std::thread> readers;
+    for(int r=0; r<3; r++) {
+        readers.emplace_back([&, r]() {
+            unsigned seed = static_cast<unsigned>(r) + 1;
+            while(!done) {
+                int limit = published.load(std::memory_order_acquire);
+                if(limit == 0) continue;
+                seed = seed * 1103515245 + 12345;
+                int i = static_cast<int>(seed % static_cast<unsigned>(limit)) & ~1; // even keys are never erased
+                std::string key = "k" + std::to_string(i);
+                epoch::Guard guard;
+                Item *item = table.findShared(key);
+                assert(item && item->value == i);
+                assert(table.findShared("missing" + key) == nullptr);
+                lookups++;
+            }
+        });
+    }
+
+    for(int i=0; i<N; i++) {
+        std::string key = "k" + std::to_string(i);
+        auto [slot, inserted] = table.insertSlot(key);
+        assert(inserted);
+        Table::publish(*slot, pool.make(key, i));
+        published.store(i + 1, std::memory_order_release);
+        if(i % 2 == 1 && i > 1000) table.erase("k" + std::to_string(i - 1000));
+        if(i % 4096 == 0) table.reclaim();
+    }
+    done = true;
+    for(auto &t: readers) t.join();
+    assert(lookups > 0);
+    assert(table.size() == static_cast<size_t>(N - (N - 1000) / 2));
+}
+
+int main(int argc, char **argv) {
+    struct { const char *name; void (*fn)(); } tests[] = {
+        {"insert_find", test_insert_find},
+        {"erase", test_erase},
+        {"growth", test_growth},
+        {"iterate", test_iterate},
+        {"collisions", test_collisions},
+        {"incremental", test_incremental},
+        {"scan", test_scan},
+        {"replace", test_replace},
+        {"sample", test_sample},
+        {"shared_readers", test_shared_readers},
+    };
+
+    for(const auto &t: tests) {
+        if(argc > 1 && std::strcmp(argv[1], t.name) != 0) continue;
+        t.fn();
+        std::cout << t.name << " passed\n";
+    }
+    return 0;
+}
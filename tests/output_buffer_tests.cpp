@@ -0,0 +1,143 @@
+/*
+This test file covers the per-connection output buffer:
+
+appending across block boundaries
+flushing to a socket that only accepts part of the backlog
+blocks are recycled through the pool
+large blobs are sent by reference, small ones copied
+*/
+
+#include "../include/output_buffer.h"
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+
+void test_append() {
+    OutputBuffer out;
+    assert(out.empty());
+
+    std::string expected;
+    for(int i=0; i<5000; i++) {
+        std::string line = "line " + std::to_string(i) + "\r\n";
+        out.append(line);
+        expected += line;
+    }
+
+    assert(out.size() == expected.size());
+    assert(out.size() > BlockPool::BLOCK_SIZE); // spans several blocks
+    assert(out.str() == expected);
+
+    out.clear();
+    assert(out.empty() && out.str().empty());
+}
+
+void test_partial_flush() {
+    int fds[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+    // more than the socket buffer can take in one go
+    std::string payload(4 * 1024 * 1024, 'x');
+    for(size_t i=0; i<payload.size(); i++) payload[i] = static_cast<char>('a' + i % 26);
+
+    OutputBuffer out;
+    out.append(payload);
+    assert(out.flush(fds[0]));
+    assert(!out.empty()); // peer hasn't read yet, flush must not block
+
+    std::string received;
+    char buf[65536];
+    while(received.size() < payload.size()) {
+        ssize_t n = recv(fds[1], buf, sizeof(buf), 0);
+        assert(n > 0);
+        received.append(buf, n);
+        assert(out.flush(fds[0]));
+    }
+
+    assert(out.empty());
+    assert(received == payload);
+
+    // writing to a closed peer reports failure
+    close(fds[1]);
+    out.append("late reply");
+    assert(!out.flush(fds[0]));
+    close(fds[0]);
+}
+
+void test_pool_reuse() {
+    size_t before = BlockPool::instance().cached();
+    {
+        OutputBuffer out;
+        out.append(std::string(3 * BlockPool::BLOCK_SIZE, 'z'));
+    }
+    assert(BlockPool::instance().cached() >= before + 3);
+
+    size_t cached = BlockPool::instance().cached();
+    {
+        OutputBuffer out;
+        out.append("small");
+        assert(BlockPool::instance().cached() == cached - 1);
+    }
+    assert(BlockPool::instance().cached() == cached);
+}
+
+void test_blob_reference() {
+    std::string text(100000, 'x');
+    for(size_t i=0; i<text.size(); i++) text[i] = static_cast<char>('a' + i % 26);
+    BlobRef blob = BlobRef::create(text);
+
+    OutputBuffer out;
+    out.append("head:");
+    out.append(blob);
+    out.append(":tail");
+    assert(blob.get()->refs() == 2); // queued, not copied
+    assert(out.size() == text.size() + 10);
+    assert(out.str() == "head:" + text + ":tail");
+
+    // small blobs are cheaper to copy
+    BlobRef small = BlobRef::create("tiny");
+    out.append(small);
+    assert(small.get()->refs() == 1);
+
+    int fds[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    std::string received;
+    char buf[65536];
+    while(!out.empty()) {
+        assert(out.flush(fds[0]));
+        ssize_t n = recv(fds[1], buf, sizeof(buf), MSG_DONTWAIT);
+        if(n > 0) received.append(buf, n);
+    }
+    while(received.size() < text.size() + 14) {
+        ssize_t n = recv(fds[1], buf, sizeof(buf), 0);
+        assert(n > 0);
+        received.append(buf, n);
+    }
+    assert(received == "head:" + text + ":tailtiny");
+    assert(blob.get()->refs() == 1); // dropped once sent
+    close(fds[0]);
+    close(fds[1]);
+
+    // clearing pending output also lets go
+    out.append(blob);
+    out.clear();
+    assert(blob.get()->refs() == 1);
+}
+
+int main(int argc, char **argv) {
+    struct { const char *name; void (*fn)(); } tests[] = {
+        {"append", test_append},
+        {"partial_flush", test_partial_flush},
+        {"pool_reuse", test_pool_reuse},
+        {"blob_reference", test_blob_reference},
+    };
+
+    for(const auto &t: tests) {
+        if(argc > 1 && std::strcmp(argv[1], t.name) != 0) continue;
+        t.fn();
+        std::cout << t.name << " passed\n";
+    }
+    return 0;
+}
@@ -0,0 +1,174 @@
+/*
+This test file covers the shared-memory transport:
+
+ring round trip of single messages
+messages larger than the ring (split into frames)
+closing a channel wakes a blocked reader
+a client process that exits without closing the channel closes it for the server
+readFor times out on an empty ring and resumes a message cut short
+ShmClient talking to a CommandParser-backed session
+*/
+
+#include "../include/shm_transport.h"
+#include "../include/storage.h"
+#include "../include/command_parser.h"
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// unique segment name per test process
+static std::string channelName(const std::string &test) {
+    return "test_" + test + "_" + std::to_string(getpid());
+}
+
+void test_round_trip() {
+    ShmChannel server(channelName("round_trip"), ShmChannel::Mode::Create, 4096);
+    ShmChannel client(channelName("round_trip"), ShmChannel::Mode::Open);
+
+    std::string out;
+    for(int i=0; i<1000; i++) {
+        std::string msg = "message " + std::to_string(i);
+        assert(client.requests().write(msg));
+        assert(server.requests().read(out));
+        assert(out == msg);
+    }
+
+    // empty messages are still delivered
+    assert(client.requests().write(""));
+    assert(server.requests().read(out));
+    assert(out.empty());
+}
+
+void test_large_message() {
+    ShmChannel server(channelName("large"), ShmChannel::Mode::Create, 4096);
+    ShmChannel client(channelName("large"), ShmChannel::Mode::Open);
+
+    std::string big(100000, 'x');
+    for(size_t i=0; i<big.size(); i++) big[i] = static_cast<char>('a' + i % 26);
+
+    std::thread producer([&]() {
+        for(int i=0; i<3; i++) assert(server.replies().write(big));
+    });
+
+    std::string out;
+    for(int i=0; i<3; i++) {
+        assert(client.replies().read(out));
+        assert(out == big);
+    }
+    producer.join();
+}
+
+void test_close_wakes_reader() {
+    ShmChannel server(channelName("close"), ShmChannel::Mode::Create, 4096);
+    ShmChannel client(channelName("close"), ShmChannel::Mode::Open);
+
+    std::thread reader([&]() {
+        std::string out;
+        assert(!server.requests().read(out));
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    client.close();
+    reader.join();
+    assert(!server.requests().write("after close"));
+}
+
+void test_dead_peer() {
+    std::string name = channelName("dead_peer"); // the child has another pid
+    ShmChannel server(name, ShmChannel::Mode::Create, 4096);
+    pid_t child = fork();
+    if(child == 0) {
+        ShmChannel client(name, ShmChannel::Mode::Open);
+        client.requests().write("last words");
+        _exit(0); // skips the destructor, so the rings are never closed
+    }
+    assert(child > 0);
+    int status = 0;
+    waitpid(child, &status, 0);
+
+    std::string out;
+    assert(server.requests().read(out) && out == "last words");
+    auto start = std::chrono::steady_clock::now();
+    assert(!server.requests().read(out));
+    assert(!server.replies().write(std::string(8192, 'x'))); // larger than the ring
+    assert(std::chrono::steady_clock::now() - start < std::chrono::seconds(2));
+}
+
+void test_read_timeout() {
+    ShmChannel server(channelName("read_timeout"), ShmChannel::Mode::Create, 4096);
+    ShmChannel client(channelName("read_timeout"), ShmChannel::Mode::Open);
+
+    std::string out;
+    auto start = std::chrono::steady_clock::now();
+    assert(server.requests().readFor(out, std::chrono::milliseconds(200)) == ShmRing::ReadStatus::TimedOut);
+    assert(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(200));
+
+    // a message spanning several frames, of which only the first fit so far
+    std::string big(6000, 'y');
+    std::thread writer([&]() { assert(client.requests().write(big)); });
+    while(server.requests().readFor(out, std::chrono::milliseconds(50)) == ShmRing::ReadStatus::TimedOut) {}
+    writer.join();
+    assert(out == big);
+
+    client.close();
+    assert(server.requests().readFor(out, std::chrono::seconds(5)) == ShmRing::ReadStatus::Closed);
+}
+
+void test_busy_channel() {
+    ShmChannel server(channelName("busy"), ShmChannel::Mode::Create, 4096);
+    ShmChannel first(channelName("busy"), ShmChannel::Mode::Open);
+
+    bool threw = false;
+    try {
+        ShmChannel second(channelName("busy"), ShmChannel::Mode::Open);
+    } catch(const std::runtime_error &) {
+        threw = true;
+    }
+    assert(threw);
+}
+
+void test_client_session() {
+    ShmChannel channel(channelName("session"), ShmChannel::Mode::Create);
+
+    std::thread session([&]() {
+        Storage store;
+        Session session(channel.fd(), channelName("session"));
+        CommandParser parser(store, session);
+        std::string request;
+        while(channel.requests().read(request)) {
+            if(!channel.replies().write(parser.execute(request))) break;
+        }
+    });
+
+    {
+        ShmClient client(channelName("session"));
+        assert(client.execute("SET greeting \"hello shm\"").find("OK") != std::string::npos);
+        assert(client.execute("GET greeting").find("hello shm") != std::string::npos);
+        assert(client.execute("EXISTS missing").find("(integer) 0") != std::string::npos);
+    }
+
+    session.join();
+}
+
+int main(int argc, char **argv) {
+    struct { const char *name; void (*fn)(); } tests[] = {
+        {"round_trip", test_round_trip},
+        {"large_message", test_large_message},
+        {"close", test_close_wakes_reader},
+        {"dead_peer", test_dead_peer},
+        {"read_timeout", test_read_timeout},
+        {"busy", test_busy_channel},
+        {"client_session", test_client_session},
+    };
+
+    for(const auto &t: tests) {
+        if(argc > 1 && std::strcmp(argv[1], t.name) != 0) continue;
+        t.fn();
+        std::cout << t.name << " passed\n";
+    }
+    return 0;
+}
@@ -0,0 +1,147 @@
+/*
+This test file covers the slab allocator behind Storage entries:
+
+size classes and per-class occupancy stats
+freed chunks are handed out again before new slabs are taken
+empty slabs go back to the system (one spare per class is kept)
+requests above MAX_CHUNK bypass the slabs
+draining sparse slabs: no new allocations, released once emptied
+*/
+
+#include "../include/slab_allocator.h"
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <set>
+#include <vector>
+
+static const SlabAllocator::ClassStats *findClass(const SlabAllocator::Stats &stats, size_t chunk) {
+    for(const auto &c: stats.classes) {
+        if(c.chunk_size == chunk) return &c;
+    }
+    return nullptr;
+}
+
+void test_classes() {
+    SlabAllocator slabs;
+    assert(slabs.stats().classes.empty());
+
+    void *a = slabs.allocate(40); // 48-byte class
+    void *b = slabs.allocate(48);
+    void *c = slabs.allocate(250); // 256-byte class
+    assert(reinterpret_cast<uintptr_t>(a) % 16 == 0);
+    std::memset(c, 0xAB, 250);
+
+    auto stats = slabs.stats();
+    assert(stats.classes.size() == 2);
+    const auto *small = findClass(stats, 48);
+    assert(small && small->slabs == 1 && small->chunks_used == 2);
+    assert(findClass(stats, 256)->chunks_used == 1);
+    assert(stats.slab_bytes == 2 * SlabAllocator::SLAB_SIZE);
+    assert(stats.used_bytes == 2 * 48 + 256);
+    assert(slabs.allocatedBytes() == stats.used_bytes);
+
+    slabs.deallocate(a, 40);
+    slabs.deallocate(b, 48);
+    slabs.deallocate(c, 250);
+    assert(slabs.stats().used_bytes == 0);
+}
+
+void test_reuse() {
+    SlabAllocator slabs;
+    std::vector<void *> chunks;
+    for(int i=0; i<100; i++) chunks.push_back(slabs.allocate(64));
+    std::set<void *> freed(chunks.begin() + 50, chunks.end());
+    for(int i=50; i<100; i++) slabs.deallocate(chunks[i], 64);
+
+    // the same chunks come back, no new slab is needed
+    for(int i=0; i<50; i++) assert(freed.count(slabs.allocate(64)));
+    assert(findClass(slabs.stats(), 64)->slabs == 1);
+}
+
+void test_release() {
+    SlabAllocator slabs;
+    const size_t perSlab = (SlabAllocator::SLAB_SIZE - 64) / 128;
+    std::vector<void *> chunks;
+    for(size_t i=0; i<perSlab * 4; i++) chunks.push_back(slabs.allocate(128));
+    assert(findClass(slabs.stats(), 128)->slabs == 4);
+    assert(slabs.slabBytes() == 4 * SlabAllocator::SLAB_SIZE);
+    assert(slabs.slabUsedBytes() == perSlab * 4 * 128);
+
+    for(void *p: chunks) slabs.deallocate(p, 128);
+
+    // everything freed: only the spare slab stays
+    auto stats = slabs.stats();
+    assert(findClass(stats, 128)->slabs == 1);
+    assert(findClass(stats, 128)->chunks_used == 0);
+    assert(stats.slab_bytes == SlabAllocator::SLAB_SIZE);
+    assert(slabs.slabBytes() == stats.slab_bytes && slabs.slabUsedBytes() == 0);
+}
+
+void test_large() {
+    SlabAllocator slabs;
+    void *big = slabs.allocate(SlabAllocator::MAX_CHUNK + 1);
+    std::memset(big, 0, SlabAllocator::MAX_CHUNK + 1);
+
+    auto stats = slabs.stats();
+    assert(stats.classes.empty());
+    assert(stats.large_allocs == 1);
+    assert(stats.large_bytes == SlabAllocator::MAX_CHUNK + 1);
+    assert(slabs.allocatedBytes() == SlabAllocator::MAX_CHUNK + 1);
+    assert(slabs.slabBytes() == 0 && slabs.slabUsedBytes() == 0);
+
+    slabs.deallocate(big, SlabAllocator::MAX_CHUNK + 1);
+    assert(slabs.stats().large_allocs == 0);
+}
+
+void test_drain() {
+    SlabAllocator slabs;
+    const size_t perSlab = (SlabAllocator::SLAB_SIZE - 64) / 64;
+    std::vector<void *> chunks;
+    for(size_t i=0; i<perSlab * 4; i++) chunks.push_back(slabs.allocate(64));
+
+    // keep one chunk in eight: four slabs at 12% occupancy
+    std::vector<void *> live;
+    for(size_t i=0; i<chunks.size(); i++) {
+        if(i % 8 == 0) live.push_back(chunks[i]);
+        else slabs.deallocate(chunks[i], 64);
+    }
+    assert(slabs.beginDrain(50) == 3); // half a slab of live data frees three
+    assert(findClass(slabs.stats(), 64)->draining == 3);
+
+    // move whatever sits in a draining slab, as Storage does
+    size_t moved = 0;
+    for(void *&p: live) {
+        if(!slabs.draining(p, 64)) continue;
+        void *fresh = slabs.allocate(64);
+        assert(!slabs.draining(fresh, 64));
+        slabs.deallocate(p, 64);
+        p = fresh;
+        moved++;
+    }
+    slabs.endDrain();
+
+    auto after = slabs.stats();
+    const auto *stats = findClass(after, 64);
+    assert(moved > 0 && stats->draining == 0);
+    assert(stats->chunks_used == live.size());
+    assert(stats->slabs == 2); // the dense slab plus the spare
+    for(void *p: live) slabs.deallocate(p, 64);
+}
+
+int main(int argc, char **argv) {
+    struct { const char *name; void (*fn)(); } tests[] = {
+        {"classes", test_classes},
+        {"reuse", test_reuse},
+        {"release", test_release},
+        {"large", test_large},
+        {"drain", test_drain},
+    };
+
+    for(const auto &t: tests) {
+        if(argc > 1 && std::strcmp(argv[1], t.name) != 0) continue;
+        t.fn();
+        std::cout << t.name << " passed\n";
+    }
+    return 0;
+}
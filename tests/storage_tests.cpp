@@ -2,17 +2,38 @@
 This test file contains all the tests for storage class and covers the following:
 
 set and get
+64-bit integers
+string_view keys (slices of a larger buffer)
 overwrite behaviour
-delete
+delete (missing and expired keys aren't reported as deleted)
 exists
 size
+scan: bounded batches, every live key once
 TTL auto-expiry
+active expiry: unread keys are removed a slice of the index at a time
 manual expire() method
+defragmentation: sparse slabs are emptied, every key survives
+maxmemory: noeviction refuses writes, LRU/LFU/TTL policies pick their victims
+loading a snapshot larger than maxmemory: noeviction fails and keeps the old keys, other policies evict
+lock-free readers never see a torn or freed value while a writer overwrites
+shared and exclusive read modes: same results, lazy expiry, dump alongside readers
+large values are kept in shared blobs that getRef() hands out without copying
+blobs up to the largest size class live in slabs, are freed from any thread, move under defrag
+incrBy/incrByFloat: missing keys, type errors, overflow, TTL kept, no lost updates
+striped counters: read as integers, shared by INCR, replaced by SET, no lost updates
+getMany/setMany: missing and expired keys, TTLs cleared, NX sets all or nothing
+readers never see part of a setMany batch, lock-free ones included
+conditional set (NX/XX, TTL kept or replaced, old value), compare-and-set, getDel
+millisecond TTLs: pexpire, pexpireAt, persist, pttl, and their JSON round trip
 */
 
 #include "../include/storage.h"
+#include <atomic>
 #include <cassert>
+#include <climits>
+#include <cstring>
 #include <iostream>
+#include <string_view>
 #include <thread>
 #include <variant>
 #include <vector>
@@ -20,7 +41,7 @@ manual expire() method
 // helper to get string from variant
 std::string asString(const Storage::Value &val) {
     if(std::holds_alternative<std::string>(val)) return std::get<std::string>(val);
-    if(std::holds_alternative<int>(val)) return std::to_string(std::get<int>(val));
+    if(std::holds_alternative<int64_t>(val)) return std::to_string(std::get<int64_t>(val));
     if (std::holds_alternative<double>(val)) return std::to_string(std::get<double>(val));
     if (std::holds_alternative<bool>(val)) return std::get<bool>(val) ? "true" : "false";
     return "<unknown>";
@@ -46,12 +67,48 @@ void test_all_types() {
     auto str_val = store.get("string_key");
     auto bool_val = store.get("bool_key");
 
-    assert(int_val && std::get<int>(*int_val) == 18);
+    assert(int_val && std::get<int64_t>(*int_val) == 18);
     assert(dbl_val && std::get<double>(*dbl_val) == 3.1415);
     assert(str_val && std::get<std::string>(*str_val) == "mini redis");
     assert(bool_val && std::get<bool>(*bool_val) == true);
 }
 
+void test_int64() {
+    Storage store;
+    const int64_t big = (int64_t(1) << 53) + 1; // not representable as a double
+    store.set("big", big);
+    store.set("min", INT64_MIN);
+
+    assert(std::get<int64_t>(*store.get("big")) == big);
+    assert(std::get<int64_t>(*store.get("min")) == INT64_MIN);
+
+    // survives a JSON round trip as an integer
+    assert(store.saveToFile("int64_test.json"));
+    Storage loaded;
+    assert(loaded.loadFromFile("int64_test.json") == Storage::LoadStatus::Ok);
+    assert(std::get<int64_t>(*loaded.get("big")) == big);
+    assert(std::get<int64_t>(*loaded.get("min")) == INT64_MIN);
+}
+
+void test_string_view_keys() {
+    Storage store;
+    const std::string buffer = "GET user:42\r\n";
+    std::string_view key(buffer.data() + 4, 7); // "user:42", not null-terminated
+
+    store.set(key, std::string("alice"));
+    assert(store.exists("user:42"));
+    assert(store.exists(key));
+    assert(std::get<std::string>(*store.get(key)) == "alice");
+
+    store.set(key, std::string("bob")); // overwrite through a view
+    assert(store.size() == 1);
+    assert(std::get<std::string>(*store.get(std::string("user:42"))) == "bob");
+
+    assert(store.expire(key, 10));
+    assert(store.del(key));
+    assert(!store.exists(key));
+}
+
 void test_overwrite() {
     Storage store;
     store.set("key", std::string("first"));
@@ -66,6 +123,14 @@ void test_delete() {
     store.set("k", true);
     assert(store.del("k") == true);
     assert(!store.exists("k"));
+    assert(store.del("k") == false);
+
+    // an expired key not swept yet is removed but not reported as deleted
+    store.set("gone", 1);
+    store.pexpire("gone", 20);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    assert(store.del("gone") == false);
+    assert(store.size() == 0);
 }
 
 void test_exists() {
@@ -93,6 +158,24 @@ void test_ttl_expiry() {
     assert(store.size() == 0); // check internal map size decreased
 }
 
+// Keys nobody reads again are still removed: the cleaner walks the index a
+// slice per tick and keeps going while most of what it sees has expired
+void test_active_expiry() {
+    StorageOptions options;
+    options.active_defrag = false;
+    Storage store(options);
+    const int N = 100000;
+    for(int i=0; i<N; i++) store.set("temp:" + std::to_string(i), i, 1);
+    for(int i=0; i<10; i++) store.set("keep:" + std::to_string(i), i);
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while(store.size() > 10 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    assert(store.size() == 10);
+    for(int i=0; i<10; i++) assert(store.exists("keep:" + std::to_string(i)));
+}
+
 void test_expire_method() {
     Storage store;
     store.set("key", "value");
@@ -141,6 +224,32 @@ void test_dump() {
     assert(snapshot.size() == 4);
 }
 
+void test_scan() {
+    Storage store;
+    std::vector<std::pair<std::string, CompactValue>> batch;
+    assert(store.scan(0, 16, batch) == 0 && batch.empty());
+
+    for(int i=0; i<1000; i++) store.set("key:" + std::to_string(i), i);
+    store.set("gone", 1, 1);
+    std::this_thread::sleep_for(std::chrono::seconds(2));
+
+    // every live key once, a bounded batch at a time
+    std::vector<int> seen(1000, 0);
+    size_t cursor = 0, batches = 0;
+    do {
+        cursor = store.scan(cursor, 64, batch);
+        assert(batch.size() <= 64);
+        for(const auto &[key, value]: batch) {
+            assert(key != "gone");
+            assert(key == "key:" + std::to_string(value.asInt()));
+            seen[value.asInt()]++;
+        }
+        batches++;
+    } while(cursor != 0);
+    assert(batches > 1);
+    for(int n: seen) assert(n == 1);
+}
+
 void test_concurrency() {
     Storage store;
     const int N = 1000;
@@ -166,19 +275,658 @@ void test_concurrency() {
     assert(store.size() == 5*N);
 }
 
-int main() {
-    test_set_and_get();
-    test_all_types();
-    test_overwrite();
-    test_delete();
-    test_exists();
-    test_size();
-    test_ttl_expiry();
-    test_expire_method();
-    test_keys_with_spaces();
-    test_edge_cases();
-    test_dump();
-    test_concurrency();
+void test_defrag() {
+    StorageOptions options;
+    options.active_defrag = false; // drive it by hand, not from the cleaner
+    Storage store(options);
+
+    const int N = 20000;
+    std::string value(100, 'v');
+    for(int i=0; i<N; i++) store.set("key:" + std::to_string(i), value + std::to_string(i), 3600);
+    // leave one key in four
+    for(int i=0; i<N; i++) {
+        if(i % 4) store.del("key:" + std::to_string(i));
+    }
+
+    auto before = store.memoryStats();
+    size_t moved = store.defragment();
+    auto after = store.memoryStats();
+    assert(moved > 0 && after.defrag_moved == moved && after.defrag_cycles == 1);
+    assert(!after.defrag_running);
+    assert(after.slabs.used_bytes <= before.slabs.used_bytes);
+    assert(after.slabs.slab_bytes * 2 < before.slabs.slab_bytes);
+
+    assert(store.size() == N / 4);
+    for(int i=0; i<N; i+=4) {
+        auto val = store.get("key:" + std::to_string(i));
+        assert(val && std::get<std::string>(*val) == value + std::to_string(i));
+    }
+
+    // nothing left to gain: no second cycle
+    assert(store.defragment() == 0);
+}
+
+// Used memory of a store holding cold:0..n-1, hot:0..n-1 and fill:0..n/2-1,
+// so a bounded store needs to evict about n/2 keys to take the fill keys
+static size_t boundFor(int n) {
+    StorageOptions options;
+    options.active_defrag = false;
+    Storage store(options);
+    for(int i=0; i<n; i++) {
+        store.set("cold:" + std::to_string(i), i);
+        store.set("hot:" + std::to_string(i), i);
+    }
+    return store.memoryStats().used_memory;
+}
+
+static int survivors(const Storage &store, const std::string &prefix) {
+    int count = 0;
+    for(const auto &kv: store.dump()) count += kv.first.compare(0, prefix.size(), prefix) == 0;
+    return count;
+}
+
+void test_noeviction() {
+    StorageOptions options;
+    options.maxmemory = 64 * 1024;
+    Storage store(options);
+
+    int stored = 0;
+    while(store.set("key:" + std::to_string(stored), stored)) stored++;
+    assert(stored > 100 && store.size() == static_cast<size_t>(stored));
+    assert(store.memoryStats().used_memory > options.maxmemory);
+    assert(store.memoryStats().evicted_keys == 0);
+
+    // reads and deletes still work, and make room again
+    assert(store.get("key:0").has_value());
+    for(int i=0; i<stored; i+=2) store.del("key:" + std::to_string(i));
+    assert(store.set("another", 1));
+}
+
+void test_load_over_limit() {
+    Storage full;
+    for(int i=0; i<5000; i++) full.set("key:" + std::to_string(i), i);
+    assert(full.saveToFile("load_over_limit_test.json"));
+
+    StorageOptions options;
+    options.maxmemory = 64 * 1024;
+    Storage refused(options);
+    for(int i=0; i<100; i++) refused.set("old:" + std::to_string(i), i);
+    size_t used = refused.memoryStats().used_memory;
+    assert(refused.loadFromFile("load_over_limit_test.json") == Storage::LoadStatus::OutOfMemory);
+    // the failed load changed nothing
+    assert(refused.size() == 100 && !refused.exists("key:0"));
+    for(int i=0; i<100; i++) assert(refused.get("old:" + std::to_string(i)));
+    assert(refused.memoryStats().used_memory == used);
+    assert(refused.set("more", 1));
+
+    options.eviction_policy = EvictionPolicy::AllKeysLru;
+    Storage evicting(options);
+    for(int i=0; i<100; i++) evicting.set("old:" + std::to_string(i), i);
+    assert(evicting.loadFromFile("load_over_limit_test.json") == Storage::LoadStatus::Ok);
+    auto stats = evicting.memoryStats();
+    assert(stats.evicted_keys > 0 && evicting.size() < 5000);
+    assert(!evicting.exists("old:0")); // replaced, not evicted into
+    assert(stats.used_memory <= options.maxmemory + 1024);
+    assert(evicting.set("more", 1));
+}
+
+void test_evict_lru() {
+    const int N = 1000;
+    StorageOptions options;
+    options.active_defrag = false;
+    options.maxmemory = boundFor(N);
+    options.eviction_policy = EvictionPolicy::AllKeysLru;
+    Storage store(options);
+
+    for(int i=0; i<N; i++) store.set("cold:" + std::to_string(i), i);
+    std::this_thread::sleep_for(std::chrono::milliseconds(2100)); // LRU clock ticks in seconds
+    for(int i=0; i<N; i++) store.set("hot:" + std::to_string(i), i);
+    for(int i=0; i<N/2; i++) assert(store.set("fill:" + std::to_string(i), i));
+
+    auto stats = store.memoryStats();
+    assert(stats.evicted_keys > 0);
+    assert(stats.used_memory <= options.maxmemory + 64);
+    // the keys idle the longest went first
+    assert(survivors(store, "hot:") > N * 95 / 100);
+    assert(survivors(store, "cold:") < N * 70 / 100);
+    assert(survivors(store, "fill:") == N / 2);
+}
+
+void test_evict_lfu() {
+    const int N = 1000;
+    StorageOptions options;
+    options.active_defrag = false;
+    options.maxmemory = boundFor(N);
+    options.eviction_policy = EvictionPolicy::AllKeysLfu;
+    Storage store(options);
+
+    for(int i=0; i<N; i++) {
+        store.set("cold:" + std::to_string(i), i);
+        store.set("hot:" + std::to_string(i), i);
+    }
+    for(int round=0; round<50; round++) {
+        for(int i=0; i<N; i++) store.get("hot:" + std::to_string(i));
+    }
+    for(int i=0; i<N/2; i++) assert(store.set("fill:" + std::to_string(i), i));
+
+    assert(store.memoryStats().evicted_keys > 0);
+    assert(survivors(store, "hot:") > N * 99 / 100);
+    assert(survivors(store, "cold:") + survivors(store, "fill:") < N + N / 2);
+}
+
+void test_evict_volatile() {
+    const int N = 1000;
+    StorageOptions options;
+    options.active_defrag = false;
+    options.maxmemory = boundFor(N);
+    options.eviction_policy = EvictionPolicy::VolatileTtl;
+    Storage store(options);
+
+    // cold keys expire in 100..1099s, hot keys never
+    for(int i=0; i<N; i++) {
+        store.set("cold:" + std::to_string(i), i, 100 + i);
+        store.set("hot:" + std::to_string(i), i);
+    }
+    for(int i=0; i<N/2; i++) assert(store.set("fill:" + std::to_string(i), i));
+
+    assert(survivors(store, "hot:") == N);
+    int cold = survivors(store, "cold:");
+    assert(cold < N);
+    // nearest expiries went first
+    int late = 0;
+    for(int i=N/2; i<N; i++) late += store.exists("cold:" + std::to_string(i));
+    assert(late > cold * 3 / 4);
+
+    // once no key has a TTL, writes over the limit fail
+    int i = 0;
+    while(store.set("more:" + std::to_string(i), i)) i++;
+    assert(survivors(store, "cold:") == 0);
+}
+
+// Readers check every value they see while one writer overwrites, deletes
+// and grows the table underneath them
+static void concurrentReads(ReadMode mode) {
+    StorageOptions options;
+    options.read_mode = mode;
+    Storage store(options);
+    const int KEYS = 64;
+    // value n of a key: n repeated n % 40 times, so inline and long strings alternate
+    auto valueFor = [](int n) {
+        std::string v;
+        for(int i=0; i<n % 40; i++) v += static_cast<char>('a' + n % 26);
+        return std::to_string(n) + ":" + v;
+    };
+    for(int k=0; k<KEYS; k++) store.set("key:" + std::to_string(k), valueFor(0));
+
+    std::atomic<bool> done{false};
+    std::atomic<long> hits{0};
+    std::vector<std::thread> readers;
+    for(int r=0; r<4; r++) {
+        readers.emplace_back([&, r]() {
+            for(int i=r; !done; i++) {
+                auto val = store.get("key:" + std::to_string(i % KEYS));
+                if(!val) continue; // deleted for a moment
+                const std::string &s = std::get<std::string>(*val);
+                int n = std::stoi(s);
+                assert(s == valueFor(n));
+                hits++;
+            }
+        });
+    }
+
+    for(int n=1; n<100000; n++) {
+        std::string key = "key:" + std::to_string(n % KEYS);
+        if(n % 7 == 0) store.del(key);
+        else store.set(key, valueFor(n));
+        if(n % 1000 == 0) store.set("grow:" + std::to_string(n), n); // resizes under the readers
+    }
+    done = true;
+    for(auto &t: readers) t.join();
+    assert(hits > 0);
+}
+
+void test_lockfree_reads() {
+    concurrentReads(ReadMode::LockFree);
+}
+
+void test_locked_reads() {
+    for(ReadMode mode: {ReadMode::Shared, ReadMode::Exclusive}) {
+        StorageOptions options;
+        options.read_mode = mode;
+        Storage store(options);
+        store.set("a", 1);
+        store.set("gone", 2, 0); // already expired
+        assert(store.exists("a") && asString(*store.get("a")) == "1");
+        assert(!store.get("missing") && !store.exists("missing"));
+
+        // an expired key reads as missing and is erased on the writer path
+        assert(store.size() == 2);
+        assert(!store.exists("gone"));
+        assert(store.size() == 1);
+        assert(store.dump().size() == 1);
+
+        concurrentReads(mode);
+    }
+
+    assert(parseReadMode("shared") == ReadMode::Shared);
+    assert(readModeName(*parseReadMode("lockfree")) == std::string("lockfree"));
+    assert(!parseReadMode("optimistic"));
+}
+
+void test_blob_values() {
+    Storage store;
+    std::string large(100 * 1024, 'L');
+    store.set("big", large);
+    store.set("small", std::string(100, 's'));
+
+    auto first = store.getRef("big");
+    auto second = store.getRef("big");
+    assert(first && first->isBlob() && first->asString() == large);
+    assert(first->asString().data() == second->asString().data()); // no copy per read
+    assert(asString(*store.get("big")) == large);
+
+    auto small = store.getRef("small");
+    assert(small && !small->isBlob() && !small->isBorrowed());
+    assert(small->asString() == std::string(100, 's'));
+
+    // the entry and its blob both count
+    assert(*store.memoryUsage("big") > large.size());
+    assert(store.memoryStats().used_memory > large.size());
+
+    // a reader's reference outlives an overwrite and a delete
+    store.set("big", 1);
+    store.del("big");
+    BlobRef held = first->blob();
+    first.reset();
+    second.reset();
+    assert(held.view() == large);
+    assert(store.memoryStats().used_memory < large.size());
+}
+
+// Blobs up to the largest size class come from the slabs: they show up in
+// the slab stats, are freed whichever thread drops them last, and defrag
+// moves them out of sparse slabs
+void test_slab_blobs() {
+    StorageOptions options;
+    options.active_defrag = false;
+    Storage store(options);
+    const size_t BLOB_CLASS = SlabAllocator::sizeClass(Blob::allocSize(1000));
+    auto blobChunks = [&]() {
+        for(const auto &c: store.memoryStats().slabs.classes)
+            if(c.chunk_size == BLOB_CLASS) return c.chunks_used;
+        return size_t(0);
+    };
+
+    std::string value(1000, 'b');
+    store.set("blob", value);
+    auto ref = store.getRef("blob");
+    assert(ref && ref->isBlob() && ref->blobPtr()->pooled());
+    assert(blobChunks() == 1);
+    store.set("huge", std::string(SlabAllocator::MAX_CHUNK, 'h'));
+    assert(!store.getRef("huge")->blobPtr()->pooled()); // above the largest class
+
+    // the last reference goes on another thread; the chunk comes back on reclaim
+    store.del("blob");
+    std::thread([moved = std::move(ref)]() mutable { moved.reset(); }).join();
+    store.defragment(); // reclaims first
+    assert(blobChunks() == 0);
+
+    const int N = 2000;
+    for(int i=0; i<N; i++) store.set("blob:" + std::to_string(i), value + std::to_string(i));
+    auto kept = store.getRef("blob:0"); // a reader's reference survives the move
+    for(int i=0; i<N; i++) {
+        if(i % 4) store.del("blob:" + std::to_string(i));
+    }
+    size_t before = store.memoryStats().slabs.slab_bytes;
+    assert(store.defragment() > 0);
+    kept.reset();
+    store.defragment();
+    assert(store.memoryStats().slabs.slab_bytes * 2 < before);
+    assert(blobChunks() == N / 4);
+    for(int i=0; i<N; i+=4) assert(asString(*store.get("blob:" + std::to_string(i))) == value + std::to_string(i));
+}
+
+void test_incr() {
+    Storage store;
+    int64_t n;
+    double d;
+    using Status = Storage::IncrStatus;
+
+    assert(store.incrBy("hits", 1, n) == Status::Ok && n == 1);
+    assert(store.incrBy("hits", 41, n) == Status::Ok && n == 42);
+    assert(store.incrBy("hits", -50, n) == Status::Ok && n == -8);
+    assert(std::get<int64_t>(*store.get("hits")) == -8);
+
+    // overflow leaves the value alone
+    store.set("big", INT64_MAX - 1);
+    assert(store.incrBy("big", 1, n) == Status::Ok && n == INT64_MAX);
+    assert(store.incrBy("big", 1, n) == Status::Overflow);
+    assert(std::get<int64_t>(*store.get("big")) == INT64_MAX);
+    store.set("small", INT64_MIN);
+    assert(store.incrBy("small", -1, n) == Status::Overflow);
+
+    // only integers count for incrBy; incrByFloat takes ints and doubles
+    store.set("name", "alice");
+    store.set("ratio", 1.5);
+    assert(store.incrBy("name", 1, n) == Status::NotNumber);
+    assert(store.incrBy("ratio", 1, n) == Status::NotNumber);
+    assert(store.incrByFloat("name", 1, d) == Status::NotNumber);
+    assert(store.incrByFloat("ratio", 0.25, d) == Status::Ok && d == 1.75);
+    assert(store.incrByFloat("hits", 0.5, d) == Status::Ok && d == -7.5);
+    assert(std::get<double>(*store.get("hits")) == -7.5);
+    assert(store.incrByFloat("ratio", 1e308, d) == Status::Ok);
+    assert(store.incrByFloat("ratio", 1e308, d) == Status::Overflow);
+    assert(store.incrByFloat("fresh", 2.5, d) == Status::Ok && d == 2.5);
+
+    // the TTL survives an increment; an expired key starts over
+    store.set("limited", 5, 1);
+    assert(store.incrBy("limited", 1, n) == Status::Ok && n == 6);
+    std::this_thread::sleep_for(std::chrono::seconds(2));
+    assert(!store.exists("limited"));
+    assert(store.incrBy("limited", 1, n) == Status::Ok && n == 1);
+    std::this_thread::sleep_for(std::chrono::seconds(2));
+    assert(store.exists("limited")); // no TTL carried over from the expired key
+
+    // concurrent increments don't lose updates
+    std::vector<std::thread> threads;
+    for(int t=0; t<4; t++) {
+        threads.emplace_back([&]() {
+            int64_t out;
+            for(int i=0; i<5000; i++) assert(store.incrBy("counter", 1, out) == Status::Ok);
+        });
+    }
+    for(auto &t: threads) t.join();
+    assert(std::get<int64_t>(*store.get("counter")) == 20000);
+}
+
+void test_striped_counter() {
+    Storage store;
+    int64_t n;
+    using Status = Storage::IncrStatus;
+
+    assert(store.incrCounter("requests", 1, n) == Status::Ok && n == 1);
+    assert(store.incrCounter("requests", 9, n) == Status::Ok && n == 10);
+    assert(std::get<int64_t>(*store.get("requests")) == 10);
+    assert(store.incrBy("requests", 5, n) == Status::Ok && n == 15); // INCR adds to the counter
+    assert(store.incrCounter("requests", 0, n) == Status::Ok && n == 15);
+    assert(*store.memoryUsage("requests") > 64);
+
+    // a plain integer becomes a counter, keeping its value and TTL
+    store.set("plain", 100, 60);
+    assert(store.incrCounter("plain", 1, n) == Status::Ok && n == 101);
+    auto dumped = store.dump();
+    assert(std::get<int64_t>(dumped.at("plain")) == 101);
+    store.set("name", "x");
+    assert(store.incrCounter("name", 1, n) == Status::NotNumber);
+
+    // overflow is judged on the total, whichever thread's cell takes the add
+    assert(store.incrCounter("max", INT64_MAX, n) == Status::Ok);
+    std::thread other([&]() {
+        int64_t r;
+        assert(store.incrCounter("max", 1, r) == Status::Overflow);
+        assert(store.incrBy("max", 1, r) == Status::Overflow);
+    });
+    other.join();
+    assert(std::get<int64_t>(*store.get("max")) == INT64_MAX);
+
+    // SET replaces the counter with a plain value
+    store.set("requests", 3);
+    assert(store.incrBy("requests", 1, n) == Status::Ok && n == 4);
+
+    // many threads, no lost updates, in every read mode
+    for(ReadMode mode: {ReadMode::LockFree, ReadMode::Shared, ReadMode::Exclusive}) {
+        StorageOptions options;
+        options.read_mode = mode;
+        Storage shared(options);
+        std::vector<std::thread> threads;
+        for(int t=0; t<8; t++) {
+            threads.emplace_back([&]() {
+                int64_t out;
+                for(int i=0; i<5000; i++) assert(shared.incrCounter("hits", 1, out) == Status::Ok);
+            });
+        }
+        for(auto &t: threads) t.join();
+        assert(std::get<int64_t>(*shared.get("hits")) == 40000);
+    }
+}
+
+void test_batch() {
+    Storage store;
+    store.set("a", 1);
+    store.set("b", "two");
+    store.set("short", 3, 1);
+    std::this_thread::sleep_for(std::chrono::seconds(2));
+
+    std::string_view keys[] = {"a", "missing", "b", "short", "a"};
+    auto values = store.getMany(keys);
+    assert(values.size() == 5);
+    assert(values[0] && values[0]->asInt() == 1);
+    assert(!values[1]);
+    assert(values[2] && values[2]->asString() == "two");
+    assert(!values[3]);
+    assert(values[4] && values[4]->asInt() == 1);
+    assert(!store.exists("short")); // the expired key was removed on the way
+
+    // a plain set clears the TTL it replaces
+    store.set("ttl", 1, 60);
+    std::pair<std::string_view, Storage::Value> pairs[] = {{"ttl", 2}, {"c", 3.5}, {"big", std::string(4096, 'x')}};
+    assert(store.setMany(pairs) == Storage::SetStatus::Ok);
+    assert(std::get<int64_t>(*store.get("ttl")) == 2);
+    assert(std::get<double>(*store.get("c")) == 3.5);
+    assert(std::get<std::string>(*store.get("big")).size() == 4096);
+    store.set("short", 1, 1);
+    std::this_thread::sleep_for(std::chrono::seconds(2));
+    assert(store.exists("ttl"));
+
+    // NX: one existing key blocks every write
+    std::pair<std::string_view, Storage::Value> fresh[] = {{"d", 4}, {"a", 5}};
+    assert(store.setMany(fresh, true) == Storage::SetStatus::ConditionFailed);
+    assert(!store.exists("d") && std::get<int64_t>(*store.get("a")) == 1);
+    std::pair<std::string_view, Storage::Value> fresh2[] = {{"d", 4}, {"e", 5}};
+    assert(store.setMany(fresh2, true) == Storage::SetStatus::Ok);
+    assert(store.exists("d") && store.exists("e"));
+
+    // an expired key counts as missing
+    std::pair<std::string_view, Storage::Value> revived[] = {{"short", 9}};
+    assert(store.setMany(revived, true) == Storage::SetStatus::Ok);
+    assert(std::get<int64_t>(*store.get("short")) == 9);
+}
+
+// Readers never see part of an MSET, in any read mode: getMany returns one
+// batch, and a GET that saw a batch is followed by GETs that see it too
+void test_batch_atomic() {
+    for(ReadMode mode: {ReadMode::LockFree, ReadMode::Shared, ReadMode::Exclusive}) {
+        StorageOptions options;
+        options.read_mode = mode;
+        Storage store(options);
+        const int KEYS = 12; // more than fit in readEntries' inline slots
+        std::vector<std::string> names;
+        for(int k=0; k<KEYS; k++) names.push_back("batch:" + std::to_string(k));
+        std::vector<std::string_view> keys(names.begin(), names.end());
+        auto writeBatch = [&](int64_t n) {
+            std::vector<std::pair<std::string_view, Storage::Value>> pairs;
+            for(auto key: keys) pairs.emplace_back(key, n);
+            assert(store.setMany(pairs) == Storage::SetStatus::Ok);
+        };
+        writeBatch(0);
+
+        std::atomic<bool> done{false};
+        std::atomic<long> reads{0};
+        std::vector<std::thread> readers;
+        for(int r=0; r<3; r++) {
+            readers.emplace_back([&]() {
+                while(!done) {
+                    auto values = store.getMany(keys);
+                    for(auto &v: values) assert(v && v->asInt() == values[0]->asInt());
+                    int64_t first = std::get<int64_t>(*store.get(keys[0]));
+                    int64_t last = std::get<int64_t>(*store.get(keys[KEYS - 1]));
+                    assert(last >= first);
+                    reads++;
+                }
+            });
+        }
+        for(int64_t n=1; n<5000; n++) writeBatch(n);
+        done = true;
+        for(auto &t: readers) t.join();
+        assert(reads > 0);
+    }
+}
+
+void test_conditional_set() {
+    Storage store;
+    using Options = Storage::SetOptions;
+    using Status = Storage::SetStatus;
+
+    Options nx;
+    nx.condition = Options::Condition::IfMissing;
+    Options xx;
+    xx.condition = Options::Condition::IfExists;
+    std::optional<CompactValue> old;
+
+    assert(store.set("k", 1, xx, &old) == Status::ConditionFailed && !old);
+    assert(!store.exists("k"));
+    assert(store.set("k", 1, nx, &old) == Status::Ok && !old);
+    assert(store.set("k", 2, nx, &old) == Status::ConditionFailed && old->asInt() == 1);
+    assert(std::get<int64_t>(*store.get("k")) == 1);
+    assert(store.set("k", std::string(600, 'v'), xx, &old) == Status::Ok && old->asInt() == 1);
+    assert(store.set("k", 3, Options(), &old) == Status::Ok && old->isBlob() && old->asString().size() == 600);
+
+    // TTLs: replaced, kept, or cleared
+    Options px;
+    px.ttl_ms = 300;
+    assert(store.set("short", "a", px) == Status::Ok);
+    Options keep;
+    keep.keep_ttl = true;
+    assert(store.set("short", "b", keep) == Status::Ok);
+    store.set("long", "a", px);
+    assert(store.set("long", "b", Options()) == Status::Ok);
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    assert(!store.exists("short"));
+    assert(std::get<std::string>(*store.get("long")) == "b");
+    assert(store.set("short", 1, nx) == Status::Ok); // expired counts as missing
+
+    // compare-and-set: same type and value, TTL kept
+    store.set("v", 5, 60);
+    assert(store.compareAndSet("v", 4, 6) == Status::ConditionFailed);
+    assert(store.compareAndSet("v", 5.0, 6) == Status::ConditionFailed);
+    assert(store.compareAndSet("v", 5, 6) == Status::Ok);
+    assert(std::get<int64_t>(*store.get("v")) == 6);
+    assert(store.compareAndSet("missing", 0, 1) == Status::ConditionFailed && !store.exists("missing"));
+    store.set("s", std::string(700, 'x'));
+    assert(store.compareAndSet("s", std::string(700, 'x'), "small") == Status::Ok);
+    assert(std::get<std::string>(*store.get("s")) == "small");
+
+    // getDel hands back the value and removes the key
+    auto taken = store.getDel("v");
+    assert(taken && taken->asInt() == 6 && !store.exists("v"));
+    assert(!store.getDel("v"));
+
+    // a CAS loop from many threads loses no update
+    store.set("n", 0);
+    std::vector<std::thread> threads;
+    for(int t=0; t<4; t++) {
+        threads.emplace_back([&]() {
+            for(int i=0; i<500; i++) {
+                while(true) {
+                    int64_t cur = std::get<int64_t>(*store.get("n"));
+                    if(store.compareAndSet("n", cur, cur + 1) == Status::Ok) break;
+                }
+            }
+        });
+    }
+    for(auto &t: threads) t.join();
+    assert(std::get<int64_t>(*store.get("n")) == 2000);
+}
+
+void test_ms_ttl() {
+    Storage store;
+    store.set("a", 1);
+    store.set("b", 2);
+
+    assert(store.pttl("a") == Storage::TTL_NONE);
+    assert(store.pttl("missing") == Storage::TTL_MISSING);
+    assert(!store.pexpire("missing", 100));
+
+    assert(store.pexpire("a", 200));
+    int64_t left = store.pttl("a");
+    assert(left > 0 && left <= 200);
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    assert(!store.exists("a"));
+    assert(store.pttl("a") == Storage::TTL_MISSING);
+    assert(!store.persist("a"));
+
+    // persist drops the TTL
+    assert(store.pexpire("b", 200));
+    assert(store.persist("b"));
+    assert(!store.persist("b"));
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    assert(store.exists("b") && store.pttl("b") == Storage::TTL_NONE);
+
+    // absolute Unix times; one in the past deletes the key
+    int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    assert(store.pexpireAt("b", now + 60000));
+    left = store.pttl("b");
+    assert(left > 59000 && left <= 60000);
+    assert(store.pexpireAt("b", now - 1000));
+    assert(!store.exists("b"));
+
+    // huge TTLs are clamped rather than wrapping into the past
+    store.set("c", 3);
+    assert(store.pexpire("c", INT64_MAX));
+    assert(store.pttl("c") > 0);
+
+    // sub-second TTLs survive SAVE/LOAD
+    store.set("d", 4);
+    store.pexpire("d", 800);
+    assert(store.saveToFile("ms_ttl_test.json"));
+    Storage loaded;
+    assert(loaded.loadFromFile("ms_ttl_test.json") == Storage::LoadStatus::Ok);
+    left = loaded.pttl("d");
+    assert(left > 0 && left <= 800);
+}
+
+int main(int argc, char **argv) {
+    struct { const char *name; void (*fn)(); } tests[] = {
+        {"set_get", test_set_and_get},
+        {"all_types", test_all_types},
+        {"int64", test_int64},
+        {"string_view_keys", test_string_view_keys},
+        {"overwrite", test_overwrite},
+        {"delete", test_delete},
+        {"exists", test_exists},
+        {"size", test_size},
+        {"ttl", test_ttl_expiry},
+        {"expire", test_expire_method},
+        {"active_expiry", test_active_expiry},
+        {"keys_with_spaces", test_keys_with_spaces},
+        {"edge_cases", test_edge_cases},
+        {"dump", test_dump},
+        {"scan", test_scan},
+        {"concurrency", test_concurrency},
+        {"defrag", test_defrag},
+        {"noeviction", test_noeviction},
+        {"load_over_limit", test_load_over_limit},
+        {"evict_lru", test_evict_lru},
+        {"evict_lfu", test_evict_lfu},
+        {"evict_volatile", test_evict_volatile},
+        {"lockfree_reads", test_lockfree_reads},
+        {"locked_reads", test_locked_reads},
+        {"blob_values", test_blob_values},
+        {"slab_blobs", test_slab_blobs},
+        {"incr", test_incr},
+        {"striped_counter", test_striped_counter},
+        {"batch", test_batch},
+        {"batch_atomic", test_batch_atomic},
+        {"conditional_set", test_conditional_set},
+        {"ms_ttl", test_ms_ttl},
+    };
+
+    // run one test by name (as CTest does) or all of them
+    for(const auto &t: tests) {
+        if(argc > 1 && std::strcmp(argv[1], t.name) != 0) continue;
+        t.fn();
+    }
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,136 @@
+/*
+This test file covers the striped counter behind CINCR:
+
+adds and the summed read, starting from an initial value
+an add reports its own cell's count: the total for a lone thread, a share otherwise
+cell counts are powers of two within the limits
+a delta that would take the total past int64 is refused, from any thread
+threads adding at once lose nothing
+*/
+
+#include "../include/striped_counter.h"
+#include <atomic>
+#include <cassert>
+#include <climits>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+void test_add() {
+    StripedCounter *counter = StripedCounter::create(10);
+    assert(counter->sum() == 10);
+    assert(counter->add(5) && counter->add(-20));
+    assert(counter->sum() == -5);
+
+    // the creating thread's cell holds the initial value
+    int64_t cell = 0;
+    assert(counter->add(1, &cell) && cell == -4);
+
+    // another thread has a cell of its own (there are at least 4)
+    std::thread([&]() {
+        int64_t own = 0;
+        assert(counter->add(3, &own) && own == 3);
+    }).join();
+    assert(counter->sum() == -1);
+    counter->release();
+}
+
+void test_cells() {
+    StripedCounter *counter = StripedCounter::create();
+    size_t cells = counter->cells();
+    assert(cells >= 4 && cells <= StripedCounter::MAX_CELLS);
+    assert((cells & (cells - 1)) == 0);
+    counter->release();
+
+    counter = StripedCounter::create(0, 6);
+    assert(counter->cells() == 4);
+    counter->release();
+
+    counter = StripedCounter::create(0, 1000);
+    assert(counter->cells() == StripedCounter::MAX_CELLS);
+    assert(counter->footprint() > StripedCounter::MAX_CELLS * 64);
+    counter->release();
+}
+
+void test_overflow() {
+    StripedCounter *counter = StripedCounter::create(INT64_MAX - 1, 4);
+    assert(counter->add(1));
+    assert(!counter->add(1));
+    assert(counter->sum() == INT64_MAX);
+
+    // another thread's cell fits the delta, but the total doesn't
+    std::thread other([&]() {
+        assert(!counter->add(1));
+        assert(!counter->add(INT64_MAX));
+        assert(counter->add(-5));
+    });
+    other.join();
+    assert(counter->sum() == INT64_MAX - 5);
+    counter->release();
+
+    // a counter that starts small and is pushed to the limit from another thread
+    counter = StripedCounter::create(0, 4);
+    assert(counter->add(5));
+    std::thread pusher([&]() { assert(counter->add(INT64_MAX - 5)); });
+    pusher.join();
+    assert(!counter->add(1));
+    assert(counter->sum() == INT64_MAX);
+    counter->release();
+
+    // the thread's own cell would overflow but the total fits: another cell takes it
+    counter = StripedCounter::create(INT64_MAX, 4);
+    std::thread low([&]() { assert(counter->add(-10)); });
+    low.join();
+    assert(counter->add(5));
+    assert(counter->sum() == INT64_MAX - 5);
+    counter->release();
+
+    // threads racing at the limit: exactly the adds that fit succeed
+    counter = StripedCounter::create(INT64_MAX - 1000, 4);
+    std::atomic<int> succeeded{0};
+    std::vector<std::thread> racers;
+    for(int t=0; t<8; t++) {
+        racers.emplace_back([&]() {
+            for(int i=0; i<1000; i++) if(counter->add(1)) succeeded++;
+        });
+    }
+    for(auto &t: racers) t.join();
+    assert(counter->sum() == INT64_MAX - 1000 + succeeded);
+    assert(succeeded <= 1000);
+    counter->release();
+}
+
+void test_threads() {
+    StripedCounter *counter = StripedCounter::create();
+    counter->retain(); // a second holder, like an entry plus a reader
+
+    std::vector<std::thread> threads;
+    for(int t=0; t<32; t++) {
+        threads.emplace_back([&]() {
+            for(int i=0; i<10000; i++) assert(counter->add(1));
+        });
+    }
+    for(auto &t: threads) t.join();
+    assert(counter->sum() == 320000);
+
+    counter->release();
+    assert(counter->sum() == 320000); // still held once
+    counter->release();
+}
+
+int main(int argc, char **argv) {
+    struct { const char *name; void (*fn)(); } tests[] = {
+        {"add", test_add},
+        {"cells", test_cells},
+        {"overflow", test_overflow},
+        {"threads", test_threads},
+    };
+
+    for(const auto &t: tests) {
+        if(argc > 1 && std::strcmp(argv[1], t.name) != 0) continue;
+        t.fn();
+        std::cout << t.name << " passed\n";
+    }
+    return 0;
+}
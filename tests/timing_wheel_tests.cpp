@@ -0,0 +1,119 @@
+/*
+This test file covers the hashed timing wheel used for connection timeouts:
+
+timers fire once their delay has passed
+rescheduling pushes the deadline back
+cancelled timers never fire
+delays longer than one revolution of the wheel
+*/
+
+#include "../include/timing_wheel.h"
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+using namespace std::chrono;
+using Clock = TimingWheel::Clock;
+
+void test_fire() {
+    auto t0 = Clock::now();
+    TimingWheel wheel(milliseconds(100), 8, t0);
+
+    int fired = 0;
+    TimingWheel::Timer timer(wheel, [&]() { fired++; });
+    wheel.schedule(timer, milliseconds(250)); // rounds up to 3 ticks
+    assert(wheel.pending() == 1);
+
+    assert(wheel.advance(t0 + milliseconds(200)) == 0);
+    assert(fired == 0);
+    assert(wheel.advance(t0 + milliseconds(300)) == 1);
+    assert(fired == 1);
+    assert(wheel.pending() == 0);
+
+    // fires only once
+    assert(wheel.advance(t0 + seconds(5)) == 0);
+    assert(fired == 1);
+}
+
+void test_reschedule() {
+    auto t0 = Clock::now();
+    TimingWheel wheel(milliseconds(100), 8, t0);
+
+    int fired = 0;
+    TimingWheel::Timer timer(wheel, [&]() { fired++; });
+    wheel.schedule(timer, milliseconds(300));
+
+    // activity at each tick keeps pushing the deadline back
+    for(int i=1; i<=20; i++) {
+        wheel.advance(t0 + milliseconds(100 * i));
+        wheel.schedule(timer, milliseconds(300));
+    }
+    assert(fired == 0);
+    assert(wheel.pending() == 1);
+
+    wheel.advance(t0 + milliseconds(2300));
+    assert(fired == 1);
+}
+
+void test_cancel() {
+    auto t0 = Clock::now();
+    TimingWheel wheel(milliseconds(100), 8, t0);
+
+    int fired = 0;
+    TimingWheel::Timer kept(wheel, [&]() { fired += 1; });
+    wheel.schedule(kept, milliseconds(100));
+    {
+        TimingWheel::Timer cancelled(wheel, [&]() { fired += 10; });
+        wheel.schedule(cancelled, milliseconds(100));
+        wheel.cancel(cancelled);
+        wheel.cancel(cancelled); // harmless when not scheduled
+
+        TimingWheel::Timer dropped(wheel, [&]() { fired += 100; });
+        wheel.schedule(dropped, milliseconds(100));
+        assert(wheel.pending() == 2);
+    } // destroying a scheduled timer cancels it
+
+    assert(wheel.pending() == 1);
+    wheel.advance(t0 + seconds(1));
+    assert(fired == 1);
+}
+
+void test_rounds() {
+    auto t0 = Clock::now();
+    TimingWheel wheel(milliseconds(10), 4, t0); // one revolution = 40ms
+
+    std::vector<int> fired_at;
+    std::vector<std::unique_ptr<TimingWheel::Timer>> timers;
+    for(int ticks=1; ticks<=13; ticks++) {
+        timers.push_back(std::make_unique<TimingWheel::Timer>(wheel, [&fired_at, ticks]() {
+            fired_at.push_back(ticks);
+        }));
+        wheel.schedule(*timers.back(), milliseconds(10 * ticks));
+    }
+
+    // step one tick at a time: each timer fires exactly on its own tick
+    for(int tick=1; tick<=13; tick++) {
+        wheel.advance(t0 + milliseconds(10 * tick));
+        assert(static_cast<int>(fired_at.size()) == tick);
+        assert(fired_at.back() == tick);
+    }
+    assert(wheel.pending() == 0);
+}
+
+int main(int argc, char **argv) {
+    struct { const char *name; void (*fn)(); } tests[] = {
+        {"fire", test_fire},
+        {"reschedule", test_reschedule},
+        {"cancel", test_cancel},
+        {"rounds", test_rounds},
+    };
+
+    for(const auto &t: tests) {
+        if(argc > 1 && std::strcmp(argv[1], t.name) != 0) continue;
+        t.fn();
+        std::cout << t.name << " passed\n";
+    }
+    return 0;
+}